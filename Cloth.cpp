@@ -13,11 +13,18 @@
 //------------------------------------------------------------------------------
 #include "Cloth.h"
 #include "ParticleSystem.h"
+#include "ClothMesh.h"
+#include "ClothLOD.h"
+#include "JobSystem.h"
+#include "ClothBenchmark.h"
+#include "ClothServer.h"
+#include "ClothTuner.h"
 
 
 //------------------------------------------------------------------------------
 // Definitions:
 //------------------------------------------------------------------------------
+const float OVER_RELAXATION = 1.5f;		//the factor C tries out
 
 //-----------------------------------------------------------------------------
 // Name: struct SPHERE_VERTEX
@@ -33,7 +40,7 @@ struct SPHERE_VERTEX
 // Name: App()
 // Desc: Constructor for the application class
 //------------------------------------------------------------------------------
-App::App()
+App::App( const char* clothMeshFile )
 {
 	//window settings
 	m_strWindowTitle	= _T( "Cloth simulation using Jakobsen's method - Neil Wakefield" );
@@ -51,8 +58,43 @@ App::App()
 		exit( 1 );
 	}
 
-	//create a particle system
-	try{ m_pParticleSystem = new ParticleSystem();	}
+	//create the cloth, shaped like the given mesh if there is one, with
+	//worker threads to step it and somewhere for them to put vertices - all
+	//set up as tuned for this machine
+	try
+	{
+		ClothMesh mesh;
+		bool useMesh = false;
+		if( clothMeshFile != NULL && clothMeshFile[ 0 ] != '\0' )
+		{
+			useMesh = SUCCEEDED( LoadClothMesh( clothMeshFile, mesh ) );
+			if( !useMesh )
+				MessageBox( NULL, clothMeshFile, "Cannot load the cloth mesh - using the grid",
+							MB_ICONEXCLAMATION | MB_OK );
+		}
+
+		ClothTuning tuning;
+		TuneCloth( ParticleSystem::DEFAULT_PRTS_PER_DIM, useMesh ? &mesh : NULL, tuning );
+
+		m_pJobs = new JobSystem( tuning.numThreads );
+
+		if( useMesh )
+			m_pClothLOD = new ClothLOD( mesh, m_pJobs, tuning.storage );
+		else
+			m_pClothLOD = new ClothLOD( ParticleSystem::DEFAULT_PRTS_PER_DIM,
+										ClothLOD::MAX_LEVELS, m_pJobs, tuning.storage );
+
+		m_pClothLOD->SetTileDim( tuning.tileDim );
+		m_pClothLOD->SetSpecialisation( tuning.specialisation );
+
+		m_pStagedVertices = new CLOTH_VERTEX[ m_pClothLOD->GetMaxParticles() ];
+
+		const char* STORAGE_NAMES[] = { "float", "half", "16-bit", "double" };
+		_stprintf( m_strTuning, _T( "Tuned%s: %d workers, %d square tiles, %s storage, %s kernels, %.2f ms/step" ),
+				   tuning.cached ? _T( " (cached)" ) : _T( "" ), tuning.numThreads,
+				   tuning.tileDim, STORAGE_NAMES[ tuning.storage ],
+				   tuning.specialisation ? _T( "specialised" ) : _T( "generic" ), tuning.stepMs );
+	}
 	catch( std::bad_alloc& )
 	{
 		MessageBox( NULL, "Out of memory", "Error", MB_ICONEXCLAMATION | MB_OK );
@@ -72,6 +114,20 @@ App::App()
 	m_numSphereFaces	= 0;
 	m_sphereFVF			= 0;
 
+	m_pParticleSystem	= m_pClothLOD->GetActive();
+	m_eyeDistance		= 1.0f;
+	m_stepPending		= false;
+	m_strCollision[ 0 ]	= 0;
+	m_strLevel[ 0 ]		= 0;
+	m_strArena[ 0 ]		= 0;
+	m_strSolver[ 0 ]	= 0;
+	m_numBenchmarkLines	= 0;
+	m_benchmarkKeyDown	= false;
+	m_solverKeyDown		= false;
+	m_pinKeyDown		= false;
+	m_tearKeyDown		= false;
+	m_accelerationKeyDown	= false;
+
 	m_wireframe = false;
 }
 
@@ -81,8 +137,13 @@ App::App()
 //------------------------------------------------------------------------------
 App::~App()
 {
-	//tidy up the particle system
-	SAFE_DELETE( m_pParticleSystem );
+	//the workers may still be stepping the cloth
+	EndClothStep();
+
+	//tidy up the particle systems
+	SAFE_DELETE( m_pClothLOD );
+	SAFE_DELETE( m_pJobs );
+	SAFE_DELETE_ARRAY( m_pStagedVertices );
 
 	//tidy up the font
 	SAFE_DELETE( m_pFont );
@@ -103,27 +164,22 @@ HRESULT App::OneTimeSceneInit()
 //------------------------------------------------------------------------------
 HRESULT App::InitDeviceObjects()
 {
-	//create the cloth vertex buffer
-	if( FAILED( m_pd3dDevice->CreateVertexBuffer( ParticleSystem::NUM_PARTICLES *
+	//the cloth must be still while its buffers are built
+	EndClothStep();
+
+	//create the cloth vertex buffer, with room for the finest level and for
+	//particles split by tearing
+	if( FAILED( m_pd3dDevice->CreateVertexBuffer( m_pClothLOD->GetMaxParticles() *
 									sizeof( CLOTH_VERTEX ),
 									D3DUSAGE_WRITEONLY, D3DFVF_CLOTHVERTEX,
 									D3DPOOL_MANAGED, &m_pClothVB, NULL ) ) )
 		return E_FAIL;
 
-	//create the cloth index buffer
-	const static int NUM_INDICES = ( ParticleSystem::PRTS_PER_DIM - 1 ) *
-								   ( ParticleSystem::PRTS_PER_DIM - 1 ) * 6;
-
-	if( FAILED( m_pd3dDevice->CreateIndexBuffer( NUM_INDICES * sizeof( int ),
-									D3DUSAGE_WRITEONLY, D3DFMT_INDEX32,
-									D3DPOOL_MANAGED, &m_pClothIB, NULL ) ) )
-		return E_FAIL;
-
 	//fill out the buffers
 	if( FAILED( m_pParticleSystem->FillVertexBuffer( m_pClothVB ) ) )
 		return E_FAIL;
 
-	if( FAILED( m_pParticleSystem->FillIndexBuffer( m_pClothIB ) ) )
+	if( FAILED( CreateClothIndexBuffer() ) )
 		return E_FAIL;
 
 	//create the cloth texture...
@@ -175,6 +231,24 @@ HRESULT App::InitDeviceObjects()
 	return S_OK;
 }
 
+//------------------------------------------------------------------------------
+// Name: CreateClothIndexBuffer
+// Desc: (Re)creates and fills the index buffer for the active cloth level -
+//		 16-bit unless the cloth is too big
+//------------------------------------------------------------------------------
+HRESULT App::CreateClothIndexBuffer()
+{
+	const ClothIndices& indices = m_pParticleSystem->GetIndices();
+
+	SAFE_RELEASE( m_pClothIB );
+	if( FAILED( m_pd3dDevice->CreateIndexBuffer( indices.GetSizeInBytes(),
+									D3DUSAGE_WRITEONLY, indices.GetFormat(),
+									D3DPOOL_MANAGED, &m_pClothIB, NULL ) ) )
+		return E_FAIL;
+
+	return m_pParticleSystem->FillIndexBuffer( m_pClothIB );
+}
+
 //------------------------------------------------------------------------------
 // Name: RestoreDeviceObjects
 // Desc: Sets up device-specific data on res change
@@ -275,12 +349,14 @@ HRESULT App::Render()
 		m_pd3dDevice->SetMaterial( &m_matCloth );
 		m_pd3dDevice->SetTexture( 0, m_pClothTexture );
 
-		const static int NUM_TRIANGLES = ( ParticleSystem::PRTS_PER_DIM - 1 ) *
-										 ( ParticleSystem::PRTS_PER_DIM - 1 ) * 2;
-
-		m_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST, 0, 0,
-											ParticleSystem::NUM_PARTICLES, 0,
-											NUM_TRIANGLES );
+		//one draw per chunk of less than 64k vertices
+		for( size_t c = 0; c < m_clothChunks.size(); ++c )
+		{
+			const IndexChunk& chunk = m_clothChunks[ c ];
+			m_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST, chunk.baseVertex, 0,
+												chunk.numVertices, chunk.firstIndex,
+												chunk.numTriangles );
+		}
 
 		m_pd3dDevice->SetTexture( 0, NULL );
 
@@ -290,6 +366,20 @@ HRESULT App::Render()
 		m_pFont->DrawText( 5.0f, 45.0f, 0xffffffff, _T( "Press R to reset cloth (syncs timestep to framerate)" ) );
 		m_pFont->DrawText( 5.0f, 65.0f, 0xffffffff, _T( "Press 1 for solid rendering mode" ) );
 		m_pFont->DrawText( 5.0f, 85.0f, 0xffffffff, _T( "Press 2 for wireframe mode" ) );
+		m_pFont->DrawText( 5.0f, 105.0f, 0xffffffff, _T( "Press T to toggle tearing, X to switch solver, C to accelerate projection" ) );
+
+		//render the collision culling counters and the level of detail
+		m_pFont->DrawText( 5.0f, 125.0f, 0xffffffff, m_strCollision );
+		m_pFont->DrawText( 5.0f, 145.0f, 0xffffffff, m_strLevel );
+		m_pFont->DrawText( 5.0f, 165.0f, 0xffffffff, m_strSolver );
+		m_pFont->DrawText( 5.0f, 185.0f, 0xffffffff, m_strArena );
+
+		m_pFont->DrawText( 5.0f, 205.0f, 0xffffffff, m_strTuning );
+
+		//render the integrator benchmark
+		m_pFont->DrawText( 5.0f, 225.0f, 0xffffffff, _T( "Press B to benchmark the integrator storage formats and index chunking" ) );
+		for( int line = 0; line < m_numBenchmarkLines; ++line )
+			m_pFont->DrawText( 5.0f, 245.0f + ( line * 20.0f ), 0xffffffff, m_strBenchmark[ line ] );
 
 		m_pd3dDevice->EndScene();
 	}
@@ -303,13 +393,19 @@ HRESULT App::Render()
 //------------------------------------------------------------------------------
 HRESULT App::FrameMove()
 {
+	//collect the step started last frame - its vertices are the ones to draw
+	const bool stepped = m_stepPending;
+	EndClothStep();
+	bool newVertices = false;
+
 	//if the R key is held down, reset the simulation
 	if( GetKeyState( 82 ) & 0x8000 )
 	{
 		if( m_fFPS > 0.0f )
-			m_pParticleSystem->SetTimeStep( 1.0f / m_fFPS );
+			m_pClothLOD->SetTimeStep( 1.0f / m_fFPS );
 
-		m_pParticleSystem->Initialise();		
+		m_pClothLOD->Initialise();		
+		newVertices = true;
 	}
 
 	if( GetKeyState( 49 ) & 0x8000 )	//1
@@ -317,22 +413,206 @@ HRESULT App::FrameMove()
 	else if( GetKeyState( 50 ) & 0x8000 )	//2
 		m_pd3dDevice->SetRenderState( D3DRS_FILLMODE, D3DFILL_WIREFRAME );
 
+	//T lets the cloth tear, or stops it, once per press
+	const bool tearKeyDown = ( GetKeyState( 84 ) & 0x8000 ) != 0;
+	if( tearKeyDown && !m_tearKeyDown )
+		m_pClothLOD->SetTearing( !m_pParticleSystem->IsTearing() );
+	m_tearKeyDown = tearKeyDown;
+
+	//B benchmarks the integrators, once per press - the workers are idle
+	//until the end of this function
+	const bool benchmarkKeyDown = ( GetKeyState( 66 ) & 0x8000 ) != 0;
+	if( benchmarkKeyDown && !m_benchmarkKeyDown )
+		RunBenchmark();
+	m_benchmarkKeyDown = benchmarkKeyDown;
+
+	//X switches between projection and XPBD, once per press
+	const bool solverKeyDown = ( GetKeyState( 88 ) & 0x8000 ) != 0;
+	if( solverKeyDown && !m_solverKeyDown )
+		m_pClothLOD->SetSolver( m_pParticleSystem->GetSolver() == SOLVER_XPBD ?
+								SOLVER_JAKOBSEN : SOLVER_XPBD );
+	m_solverKeyDown = solverKeyDown;
+
+	//C moves projection from plain sweeps to Chebyshev extrapolation, then
+	//to over-relaxation, then back, once per press
+	const bool accelerationKeyDown = ( GetKeyState( 67 ) & 0x8000 ) != 0;
+	if( accelerationKeyDown && !m_accelerationKeyDown )
+	{
+		if( m_pParticleSystem->IsChebyshev() )
+		{
+			m_pClothLOD->SetChebyshev( false );
+			m_pClothLOD->SetOverRelaxation( OVER_RELAXATION );
+		}
+		else if( m_pParticleSystem->GetOverRelaxation() != 1.0f )
+			m_pClothLOD->SetOverRelaxation( 1.0f );
+		else
+			m_pClothLOD->SetChebyshev( true );
+	}
+	m_accelerationKeyDown = accelerationKeyDown;
+
+	//P pins the cloth where it is, or lets it go, once per press
+	const bool pinKeyDown = ( GetKeyState( 80 ) & 0x8000 ) != 0;
+	if( pinKeyDown && !m_pinKeyDown )
+		m_pClothLOD->SetPinned( m_pParticleSystem->GetNumAnchors() == 0 );
+	m_pinKeyDown = pinKeyDown;
+
+	//the arrow keys move the eye point in and out
+	if( GetKeyState( VK_UP ) & 0x8000 )
+		m_eyeDistance = max( m_eyeDistance * 0.98f, 0.5f );
+	else if( GetKeyState( VK_DOWN ) & 0x8000 )
+		m_eyeDistance = min( m_eyeDistance * 1.02f, 20.0f );
+
+	D3DXVECTOR3 vEyePt		= D3DXVECTOR3( 1.1f, 0.6f, 1.1f ) * m_eyeDistance;
+
+	//pick the cloth resolution for its size on screen
+	bool newIndices = false;
+	if( m_pClothLOD->Update( vEyePt, D3DX_PI/4, float( m_d3dsdBackBuffer.Height ) ) )
+	{
+		m_pParticleSystem = m_pClothLOD->GetActive();
+		newIndices = true;
+		newVertices = true;
+	}
+
 	//set up the view transform
 	D3DXMATRIX matView;
-	D3DXVECTOR3 vEyePt		= D3DXVECTOR3( 1.1f, 0.6f, 1.1f );
 	D3DXVECTOR3 vLookAtPt	= m_pParticleSystem->GetPosition();
 	vLookAtPt[ 1 ]			-= 0.35f;
 	D3DXVECTOR3 vUp			= D3DXVECTOR3( 0.0f, 1.0f, 0.0f );
     D3DXMatrixLookAtLH( &matView, &vEyePt, &vLookAtPt, &vUp );
 	m_pd3dDevice->SetTransform( D3DTS_VIEW, &matView );	
 
-	//update the cloth model
-	m_pParticleSystem->TimeStep();
-	m_pParticleSystem->FillVertexBuffer( m_pClothVB );
+	//a reset or a new level makes last frame's step stale
+	if( newVertices )
+	{
+		if( FAILED( m_pParticleSystem->FillVertexBuffer( m_pClothVB ) ) )
+			return E_FAIL;
+	}
+	else if( stepped )
+	{
+		CLOTH_VERTEX* pBuffer = NULL;
+		const UINT size = m_pParticleSystem->GetNumParticles() * sizeof( CLOTH_VERTEX );
+		if( FAILED( m_pClothVB->Lock( 0, size, (void**)&pBuffer, 0 ) ) )
+			return E_FAIL;
+
+		memcpy( pBuffer, m_pStagedVertices, size );
+		m_pClothVB->Unlock();
+	}
+
+	//a new level has its own triangles, and a tear can outgrow a 16-bit chunk,
+	//forcing a new index format
+	D3DINDEXBUFFER_DESC desc;
+	m_pClothIB->GetDesc( &desc );
+
+	if( newIndices || desc.Format != m_pParticleSystem->GetIndices().GetFormat() )
+	{
+		if( FAILED( CreateClothIndexBuffer() ) )
+			return E_FAIL;
+	}
+
+	//send over only the triangles patched by tearing
+	m_pParticleSystem->UpdateIndexBuffer( m_pClothIB );
+
+	//keep what Render() needs, as the cloth is about to change under it
+	const ClothIndices& indices = m_pParticleSystem->GetIndices();
+	m_clothChunks.resize( indices.GetNumChunks() );
+	for( int c = 0; c < indices.GetNumChunks(); ++c )
+		m_clothChunks[ c ] = indices.GetChunk( c );
+
+	const CollisionStats& stats = m_pParticleSystem->GetCollisionStats();
+	_stprintf( m_strCollision, _T( "Collision: %d of %d tiles culled, %d particle tests" ),
+			   stats.numTilesCulled, stats.numTiles, stats.numParticleTests );
+	_stprintf( m_strLevel, _T( "Level %d of %d: %d particles, %.0f pixels high (arrows zoom), %d workers, %s%s" ),
+			   m_pClothLOD->GetActiveLevel(), m_pClothLOD->GetNumLevels(),
+			   m_pParticleSystem->GetNumParticles(), m_pClothLOD->GetScreenSize(),
+			   m_pJobs->GetNumThreads(),
+			   m_pParticleSystem->GetSolver() == SOLVER_XPBD ? _T( "XPBD" ) : _T( "projection" ),
+			   m_pParticleSystem->IsTearing() ? _T( ", tearing" ) : _T( "" ) );
+
+	//the specialised grid kernels run no sweeps of their own to record
+	const SolverStats& solver = m_pParticleSystem->GetSolverStats();
+	if( m_pParticleSystem->IsSpecialised() )
+		_stprintf( m_strSolver, _T( "Relaxation: grid kernel, error %.2e after collision" ),
+				   m_pParticleSystem->MeasureResidual() );
+	else
+		_stprintf( m_strSolver, _T( "Relaxation: %s, %d sweeps, error %.2e to %.2e, rate %.2f, %d fallbacks, %.2e after collision" ),
+				   m_pParticleSystem->GetSolver() == SOLVER_XPBD ? _T( "XPBD" ) :
+				   m_pParticleSystem->IsChebyshev() ? _T( "Chebyshev" ) :
+				   m_pParticleSystem->GetOverRelaxation() != 1.0f ? _T( "over-relaxed" ) : _T( "plain" ),
+				   solver.numSweeps, solver.firstResidual, solver.lastResidual,
+				   solver.spectralRadius, solver.numFallbacks, m_pParticleSystem->MeasureResidual() );
+
+	const ArenaStats& arena = m_pParticleSystem->GetArenaStats();
+	_stprintf( m_strArena, _T( "Memory: %d KB in %d arrays, %d bytes padding, %d KB pages%s" ),
+			   int( arena.usedBytes / 1024 ), arena.numArrays, int( arena.paddingBytes ),
+			   int( arena.pageSize / 1024 ), arena.firstTouched ? _T( ", placed by workers" ) : _T( "" ) );
+
+	//step the cloth for the next frame while this one is drawn
+	m_pParticleSystem->BeginTimeStep( *m_pJobs, m_pStagedVertices );
+	m_stepPending = true;
 
     return S_OK;
 }
 
+//------------------------------------------------------------------------------
+// Name: EndClothStep()
+// Desc: Waits for the workers to finish any step of the cloth in progress
+//------------------------------------------------------------------------------
+void App::EndClothStep()
+{
+	if( m_stepPending )
+	{
+		m_pParticleSystem->EndTimeStep( *m_pJobs );
+		m_stepPending = false;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: RunBenchmark()
+// Desc: Benchmarks each integrator storage format on a default grid cloth,
+//		 and the index list chunking on a grid too big for one 16-bit chunk,
+//		 and keeps the results for display
+//------------------------------------------------------------------------------
+void App::RunBenchmark()
+{
+	const int BENCHMARK_STEPS = 200;
+	const int INDEX_PRTS_PER_DIM = 512;
+
+	IntegratorBenchmark results[ MAX_BENCHMARK_LINES ];
+	IndexBenchmark indexResults[ MAX_BENCHMARK_LINES ];
+	int numIndexLines = 0;
+	try
+	{
+		m_numBenchmarkLines = RunIntegratorBenchmark( ParticleSystem::DEFAULT_PRTS_PER_DIM,
+													  BENCHMARK_STEPS, results,
+													  MAX_BENCHMARK_LINES );
+		numIndexLines = RunIndexBenchmark( INDEX_PRTS_PER_DIM, indexResults,
+										   MAX_BENCHMARK_LINES - m_numBenchmarkLines );
+	}
+	catch( std::bad_alloc& )
+	{
+		m_numBenchmarkLines = 0;
+		return;
+	}
+
+	for( int line = 0; line < m_numBenchmarkLines; ++line )
+	{
+		const IntegratorBenchmark& r = results[ line ];
+		_stprintf( m_strBenchmark[ line ],
+				   _T( "%s: %d bytes/particle + %d scratch, %d KB, integrate %.2f ns/particle, step %.3f ms, drift %.2g" ),
+				   r.name, r.stateBytes, r.scratchBytes, int( r.arenaBytes / 1024 ),
+				   r.integrateNs, r.stepMs, r.maxDrift );
+	}
+
+	for( int line = 0; line < numIndexLines; ++line )
+	{
+		const IndexBenchmark& r = indexResults[ line ];
+		_stprintf( m_strBenchmark[ m_numBenchmarkLines++ ],
+				   _T( "Indices in %s order: %d triangles in %d chunks, %s, ACMR %.2f to %.2f, build %.0f ms" ),
+				   r.name, r.numTriangles, r.numChunks, r.is16Bit ? _T( "16-bit" ) : _T( "32-bit" ),
+				   r.sourceACMR, r.optimisedACMR, r.buildMs );
+	}
+}
+
 //------------------------------------------------------------------------------
 // Name: InvalidateDeviceObjects
 // Desc: Tidies up device-specific data on res change
@@ -381,13 +661,60 @@ HRESULT App::FinalCleanup()
 	return S_OK;
 }
 
+//------------------------------------------------------------------------------
+// Name: GetClothMeshFile()
+// Desc: Copies the .obj file's path out of the rest of the command line,
+//		 without the spaces around it or the quotes a path with spaces comes
+//		 in. An empty path means there is no file.
+//------------------------------------------------------------------------------
+static void GetClothMeshFile( const char* args, char* pFile, const size_t size )
+{
+	while( *args == ' ' || *args == '\t' )
+		++args;
+
+	//a quoted path runs to the closing quote, any other to the end
+	size_t length = 0;
+	if( *args == '"' )
+	{
+		++args;
+		const char* pQuote = strchr( args, '"' );
+		length = ( pQuote != NULL ) ? size_t( pQuote - args ) : strlen( args );
+	}
+	else
+	{
+		length = strlen( args );
+		while( length > 0 && ( args[ length - 1 ] == ' ' || args[ length - 1 ] == '\t' ) )
+			--length;
+	}
+
+	if( length > size - 1 )
+		length = size - 1;
+	memcpy( pFile, args, length );
+	pFile[ length ] = '\0';
+}
+
 //------------------------------------------------------------------------------
 // Name: WinMain()
 // Desc: Entry point for the application
 //------------------------------------------------------------------------------
 INT WINAPI WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, INT nShowCmd )
 {
-	App theApp;
+	//-host, on its own or before the file, runs the cloth with no window,
+	//for other processes to read - see ClothServer.h. Either way, an
+	//optional .obj file on the command line gives the shape of the cloth.
+	const char HOST_SWITCH[] = "-host";
+	const size_t hostLength = sizeof( HOST_SWITCH ) - 1;
+	const bool host = strncmp( lpCmdLine, HOST_SWITCH, hostLength ) == 0 &&
+					  ( lpCmdLine[ hostLength ] == '\0' || lpCmdLine[ hostLength ] == ' ' ||
+						lpCmdLine[ hostLength ] == '\t' );
+
+	char clothMeshFile[ MAX_PATH ];
+	GetClothMeshFile( host ? lpCmdLine + hostLength : lpCmdLine, clothMeshFile, MAX_PATH );
+
+	if( host )
+		return RunClothServer( DEFAULT_CLOTH_SERVER_NAME, clothMeshFile );
+
+	App theApp( clothMeshFile );
 	theApp.Create( hInstance );
 	return theApp.Run();
 }
@@ -16,6 +16,7 @@
 // Included files:
 //------------------------------------------------------------------------------
 #include <new>
+#include <vector>
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <d3dx9.h>
@@ -27,12 +28,16 @@
 #include "D3DFont.h"
 
 #include "Resource.h"
+#include "ClothIndices.h"
 
 
 //------------------------------------------------------------------------------
 // Prototypes and declarations:
 //------------------------------------------------------------------------------
 class ParticleSystem;
+class ClothLOD;
+class JobSystem;
+struct CLOTH_VERTEX;
 
 //-----------------------------------------------------------------------------
 // Name: struct MESH_VERTEX
@@ -51,7 +56,7 @@ struct MESH_VERTEX
 class App : public CD3DApplication
 {
 public:
-	App();
+	App( const char* clothMeshFile = NULL );
 	~App();
 
 	HRESULT OneTimeSceneInit();
@@ -64,11 +69,41 @@ public:
 	HRESULT FrameMove();
 
 private:
+	HRESULT CreateClothIndexBuffer();
+	void EndClothStep();
+	void RunBenchmark();
+
 	bool m_wireframe;
 
 	CD3DFont* m_pFont;
 
-	ParticleSystem* m_pParticleSystem;
+	ClothLOD* m_pClothLOD;
+	ParticleSystem* m_pParticleSystem;	//the active level of m_pClothLOD
+	float m_eyeDistance;				//scale on the eye point
+
+	//the cloth steps on the worker threads while the last step is drawn
+	JobSystem* m_pJobs;
+	CLOTH_VERTEX* m_pStagedVertices;	//where the running step puts its vertices
+	bool m_stepPending;
+
+	//what Render() needs from the cloth, copied while no step is running
+	std::vector< IndexChunk > m_clothChunks;
+	TCHAR m_strCollision[ 128 ];
+	TCHAR m_strLevel[ 128 ];
+	TCHAR m_strArena[ 128 ];
+	TCHAR m_strSolver[ 128 ];
+	TCHAR m_strTuning[ 128 ];
+
+	//the last benchmark, one line per storage format then one per triangle
+	//order the index lists were chunked in
+	enum { MAX_BENCHMARK_LINES = 12 };
+	TCHAR m_strBenchmark[ MAX_BENCHMARK_LINES ][ 128 ];
+	int m_numBenchmarkLines;
+	bool m_benchmarkKeyDown;
+	bool m_solverKeyDown;
+	bool m_pinKeyDown;
+	bool m_tearKeyDown;
+	bool m_accelerationKeyDown;
 
 	LPDIRECT3DVERTEXBUFFER9 m_pClothVB;
 	LPDIRECT3DINDEXBUFFER9 m_pClothIB;
@@ -0,0 +1,218 @@
+//------------------------------------------------------------------------------
+// File: ClothArena.cpp
+// Desc: One aligned block of memory holding every array of a cloth
+//
+// Created: 18 October 2026 16:19:50
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <string.h>
+#include <new>
+#include "ClothArena.h"
+#include "JobSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: EnableLockMemoryPrivilege()
+// Desc: Large pages can only be had with the lock pages privilege, which the
+//		 account must hold and the process must switch on
+//------------------------------------------------------------------------------
+static bool EnableLockMemoryPrivilege()
+{
+	HANDLE hToken;
+	if( !OpenProcessToken( GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES, &hToken ) )
+		return false;
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount				= 1;
+	privileges.Privileges[ 0 ].Attributes	= SE_PRIVILEGE_ENABLED;
+
+	bool enabled = false;
+	if( LookupPrivilegeValue( NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[ 0 ].Luid ) &&
+		AdjustTokenPrivileges( hToken, FALSE, &privileges, 0, NULL, NULL ) )
+	{
+		//succeeds without granting anything if the account lacks the privilege
+		enabled = ( GetLastError() == ERROR_SUCCESS );
+	}
+
+	CloseHandle( hToken );
+	return enabled;
+}
+
+//------------------------------------------------------------------------------
+// Name: ClothArena()
+// Desc: Constructor for an empty arena
+//------------------------------------------------------------------------------
+ClothArena::ClothArena()
+{
+	m_pBase		= NULL;
+	m_used		= 0;
+	m_sizing	= false;
+	m_numSpans	= 0;
+	memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+//------------------------------------------------------------------------------
+// Name: ~ClothArena()
+// Desc: Destructor for the arena - frees the block
+//------------------------------------------------------------------------------
+ClothArena::~ClothArena()
+{
+	Release();
+}
+
+//------------------------------------------------------------------------------
+// Name: Release()
+// Desc: Gives the block back to the system
+//------------------------------------------------------------------------------
+void ClothArena::Release()
+{
+	if( m_pBase != NULL )
+		VirtualFree( m_pBase, 0, MEM_RELEASE );
+
+	m_pBase = NULL;
+}
+
+//------------------------------------------------------------------------------
+// Name: BeginSizing()
+// Desc: Starts counting the bytes the owner's arrays need
+//------------------------------------------------------------------------------
+void ClothArena::BeginSizing()
+{
+	m_sizing				= true;
+	m_used					= 0;
+	m_stats.paddingBytes	= 0;
+	m_stats.numArrays		= 0;
+}
+
+//------------------------------------------------------------------------------
+// Name: Reserve()
+// Desc: Gets a block big enough for the sizing pass. Large pages are only
+//		 worth asking for once the block fills one; they come locked in
+//		 memory, so first touch has no say in where they go.
+//------------------------------------------------------------------------------
+void ClothArena::Reserve( const DWORD flags )
+{
+	Release();
+
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+
+	const size_t size		= m_used;
+	m_stats.largePages		= false;
+	m_stats.firstTouched	= false;
+	m_stats.pageSize		= info.dwPageSize;
+
+	if( flags & LARGE_PAGES )
+	{
+		const size_t largePage = GetLargePageMinimum();
+		if( largePage != 0 && size >= largePage && EnableLockMemoryPrivilege() )
+		{
+			const size_t rounded = ( size + largePage - 1 ) & ~( largePage - 1 );
+			m_pBase = (BYTE*)VirtualAlloc( NULL, rounded,
+										   MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+										   PAGE_READWRITE );
+			if( m_pBase != NULL )
+			{
+				m_stats.largePages		= true;
+				m_stats.pageSize		= largePage;
+				m_stats.reservedBytes	= rounded;
+			}
+		}
+	}
+
+	if( m_pBase == NULL )
+	{
+		const size_t rounded = ( size + info.dwPageSize - 1 ) & ~size_t( info.dwPageSize - 1 );
+		m_pBase = (BYTE*)VirtualAlloc( NULL, rounded, MEM_RESERVE | MEM_COMMIT,
+									   PAGE_READWRITE );
+		if( m_pBase == NULL )
+			throw std::bad_alloc();
+
+		m_stats.reservedBytes = rounded;
+	}
+
+	++m_stats.numReserves;
+	m_numSpans				= 0;
+	m_sizing				= false;
+	m_used					= 0;
+	m_stats.usedBytes		= 0;
+	m_stats.paddingBytes	= 0;
+	m_stats.numArrays		= 0;
+}
+
+//------------------------------------------------------------------------------
+// Name: CarveBytes()
+// Desc: Hands out the next aligned piece of the block, or just counts it
+//		 while sizing
+//------------------------------------------------------------------------------
+void* ClothArena::CarveBytes( const size_t size )
+{
+	const size_t start = ( m_used + ALIGNMENT - 1 ) & ~size_t( ALIGNMENT - 1 );
+
+	m_stats.paddingBytes	+= start - m_used;
+	m_used					= start + size;
+	++m_stats.numArrays;
+
+	if( m_sizing )
+		return NULL;
+
+	//the carving pass must ask for exactly what the sizing pass did
+	if( m_used > m_stats.reservedBytes )
+		throw std::bad_alloc();
+
+	m_stats.usedBytes = m_used;
+	return m_pBase + start;
+}
+
+//------------------------------------------------------------------------------
+// Name: FirstTouch()
+// Desc: Writes to every page of the block from the workers, one even span
+//		 each. Windows puts a page on the node of the thread that first
+//		 touches it, so the block ends up spread over the workers' nodes
+//		 rather than piled on the main thread's. Must come before anything
+//		 else writes to the arrays.
+//------------------------------------------------------------------------------
+void ClothArena::FirstTouch( JobSystem& jobs )
+{
+	if( m_pBase == NULL || m_stats.largePages )
+		return;
+
+	m_numSpans = jobs.GetNumThreads() + 1;
+
+	JobGraph graph;
+	for( int span = 0; span < m_numSpans; ++span )
+		graph.AddJob( TouchJob, this, span );
+
+	jobs.Submit( graph );
+	jobs.Wait( graph );
+
+	m_stats.firstTouched = true;
+}
+
+//------------------------------------------------------------------------------
+// Name: TouchJob()
+// Desc: Writes one byte to each page of one span of the block
+//------------------------------------------------------------------------------
+void ClothArena::TouchJob( void* pContext, const int span )
+{
+	ClothArena* const pArena = (ClothArena*)pContext;
+
+	const size_t pageSize	= pArena->m_stats.pageSize;
+	const size_t numPages	= pArena->m_stats.reservedBytes / pageSize;
+	const size_t first		= ( numPages * span ) / pArena->m_numSpans;
+	const size_t last		= ( numPages * ( span + 1 ) ) / pArena->m_numSpans;
+
+	for( size_t page = first; page < last; ++page )
+		pArena->m_pBase[ page * pageSize ] = 0;
+}
@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// File: ClothArena.h
+// Desc: One aligned block of memory holding every array of a cloth
+//
+// Created: 18 October 2026 16:19:50
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_CLOTHARENA_H
+#define INCLUSIONGUARD_CLOTHARENA_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <windows.h>
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+class JobSystem;
+
+//------------------------------------------------------------------------------
+// Name: struct ArenaStats
+// Desc: What an arena holds, and what it cost to hold it
+//------------------------------------------------------------------------------
+struct ArenaStats
+{
+	size_t	reservedBytes;		//size of the block, rounded to whole pages
+	size_t	usedBytes;			//handed out, padding included
+	size_t	paddingBytes;		//lost to alignment
+	int		numArrays;			//arrays carved from the block
+	int		numReserves;		//blocks asked of the system so far
+	size_t	pageSize;
+	bool	largePages;			//the block is on large pages
+	bool	firstTouched;		//the workers placed the pages
+};
+
+//------------------------------------------------------------------------------
+// Name: class ClothArena
+// Desc: Carves arrays out of one block from VirtualAlloc, each on its own
+//		 cache line. The owner carves everything twice with the same code:
+//		 once to size the block and once, after Reserve(), for real. Nothing
+//		 is freed until the arena goes, so resetting the cloth allocates
+//		 nothing. Throws std::bad_alloc if the block cannot be had.
+//------------------------------------------------------------------------------
+class ClothArena
+{
+public:
+	const static int ALIGNMENT = 64;	//one cache line
+
+	//flags for Reserve()
+	enum
+	{
+		LARGE_PAGES = 1		//try large pages, falling back to normal ones
+	};
+
+	ClothArena();
+	~ClothArena();
+
+	//starts a sizing pass, in which Carve() counts bytes and hands out NULL
+	void BeginSizing();
+
+	//gets a block the size the sizing pass counted, and starts handing it out
+	void Reserve( const DWORD flags );
+
+	//points p at count aligned, uninitialised Ts
+	template< class T > void Carve( T*& p, const int count )
+	{
+		p = (T*)CarveBytes( sizeof( T ) * count );
+	}
+
+	//has the workers write to the block first, so that on a NUMA machine
+	//its pages are spread over the nodes they run on
+	void FirstTouch( JobSystem& jobs );
+
+	const ArenaStats& GetStats() const { return m_stats; }
+
+private:
+	void* CarveBytes( const size_t size );
+	void Release();
+	static void TouchJob( void* pContext, const int span );
+
+	BYTE*		m_pBase;
+	size_t		m_used;
+	bool		m_sizing;
+	int			m_numSpans;		//pieces the block is split into for FirstTouch()
+	ArenaStats	m_stats;
+};
+
+
+#endif //INCLUSIONGUARD_CLOTHARENA_H
@@ -0,0 +1,203 @@
+//------------------------------------------------------------------------------
+// File: ClothBenchmark.cpp
+// Desc: Measures what each integrator storage format costs and saves, and
+//		 how the index lists chunk
+//
+// Created: 18 October 2026 16:30:46
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "ClothBenchmark.h"
+#include "Integrators.h"
+#include "ClothIndices.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//enough particles that the integration streams from memory
+static const int BENCHMARK_PARTICLES	= 1 << 20;
+static const int BENCHMARK_PASSES		= 8;
+
+//------------------------------------------------------------------------------
+// Name: GetSeconds()
+// Desc: Reads the performance counter in seconds
+//------------------------------------------------------------------------------
+static double GetSeconds()
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter( &counter );
+	QueryPerformanceFrequency( &frequency );
+
+	return double( counter.QuadPart ) / double( frequency.QuadPart );
+}
+
+//------------------------------------------------------------------------------
+// Name: TimeIntegrator()
+// Desc: Returns the best time per particle, in nanoseconds, of a few passes
+//		 of one integrator over a large cloth-like block of particles. The
+//		 commit of a compact integrator is part of its cost.
+//------------------------------------------------------------------------------
+static float TimeIntegrator( const IntegratorEntry& integrator )
+{
+	const float QUANT_STEP = 1.0f / 32767.0f;
+
+	std::vector< D3DXVECTOR3 > positions( BENCHMARK_PARTICLES );
+	std::vector< D3DXVECTOR3 > accelerations( BENCHMARK_PARTICLES );
+	std::vector< double > state( ( BENCHMARK_PARTICLES * integrator.stateSize ) /
+								 sizeof( double ) + 1 );
+
+	for( int i = 0; i < BENCHMARK_PARTICLES; ++i )
+	{
+		positions[ i ] = D3DXVECTOR3( float( i & 1023 ) / 1024.0f, 0.0f,
+									  float( i >> 10 ) / 1024.0f );
+		integrator.pfnSetOld( &state[ 0 ], &positions[ 0 ], i, positions[ i ], QUANT_STEP );
+	}
+
+	IntegrateParams params;
+	params.pPos			= &positions[ 0 ];
+	params.pState		= &state[ 0 ];
+	params.pAcc			= &accelerations[ 0 ];
+	params.timeStep		= 0.002f;
+	params.quantStep	= QUANT_STEP;
+	params.first		= 0;
+	params.count		= BENCHMARK_PARTICLES;
+
+	double best = 1e30;
+	for( int pass = 0; pass < BENCHMARK_PASSES; ++pass )
+	{
+		//the compact integrators leave their old positions in the accelerations
+		std::fill( accelerations.begin(), accelerations.end(),
+				   D3DXVECTOR3( 0.0f, -2.0f, 0.0f ) );
+
+		const double start = GetSeconds();
+		integrator.pfnIntegrate( params );
+		if( integrator.pfnCommit != NULL )
+			integrator.pfnCommit( params );
+		best = std::min( best, GetSeconds() - start );
+	}
+
+	return float( best * 1e9 / BENCHMARK_PARTICLES );
+}
+
+//------------------------------------------------------------------------------
+// Name: RunIntegratorBenchmark()
+// Desc: Times every integrator in the registry and compares their cloths
+//		 with the double precision one
+//------------------------------------------------------------------------------
+int RunIntegratorBenchmark( const int prtsPerDim, const int numSteps,
+							IntegratorBenchmark* pResults, const int maxResults )
+{
+	//the reference cloth
+	ParticleSystem reference( prtsPerDim, NULL, STORE_DOUBLE, COMPUTE_DOUBLE );
+	for( int step = 0; step < numSteps; ++step )
+		reference.TimeStep();
+
+	const int numResults = std::min( GetNumIntegrators(), maxResults );
+	for( int i = 0; i < numResults; ++i )
+	{
+		const IntegratorEntry& integrator = GetIntegrator( i );
+		IntegratorBenchmark& result = pResults[ i ];
+
+		result.name			= integrator.name;
+		result.stateBytes	= integrator.stateSize;
+		result.scratchBytes	= integrator.scratchSize;
+		result.integrateNs	= TimeIntegrator( integrator );
+
+		//step a whole cloth kept this way
+		ParticleSystem cloth( prtsPerDim, NULL, integrator.storage, integrator.precision );
+
+		const double start = GetSeconds();
+		for( int step = 0; step < numSteps; ++step )
+			cloth.TimeStep();
+		result.stepMs = float( ( GetSeconds() - start ) * 1000.0 / std::max( numSteps, 1 ) );
+
+		result.arenaBytes	= cloth.GetArenaStats().usedBytes;
+		result.maxDrift		= 0.0f;
+		for( int p = 0; p < cloth.GetNumParticles(); ++p )
+		{
+			const D3DXVECTOR3 vDrift = cloth.GetParticlePosition( p ) -
+									   reference.GetParticlePosition( p );
+			result.maxDrift = std::max( result.maxDrift, D3DXVec3Length( &vDrift ) );
+		}
+	}
+
+	return numResults;
+}
+
+//------------------------------------------------------------------------------
+// Name: RunIndexBenchmark()
+// Desc: Chunks the same grid's triangles in several orders
+//------------------------------------------------------------------------------
+int RunIndexBenchmark( const int prtsPerDim, IndexBenchmark* pResults,
+					   const int maxResults )
+{
+	const char* const ORDER_NAMES[] = { "rows", "columns", "shuffled" };
+	const int NUM_ORDERS = sizeof( ORDER_NAMES ) / sizeof( ORDER_NAMES[ 0 ] );
+	const int quadsPerDim = prtsPerDim - 1;
+	const int numTriangles = quadsPerDim * quadsPerDim * 2;
+
+	std::vector< int > triangles( numTriangles * 3 );
+	ClothIndices indices;
+
+	const int numResults = std::min( NUM_ORDERS, maxResults );
+	for( int i = 0; i < numResults; ++i )
+	{
+		//two triangles per quad, quads walked by row or by column
+		int* pTriangle = &triangles[ 0 ];
+		for( int outer = 0; outer < quadsPerDim; ++outer )
+		{
+			for( int inner = 0; inner < quadsPerDim; ++inner )
+			{
+				const int row		= ( i == 1 ) ? inner : outer;
+				const int column	= ( i == 1 ) ? outer : inner;
+				const int corner	= row * prtsPerDim + column;
+
+				pTriangle[ 0 ] = corner;
+				pTriangle[ 1 ] = corner + prtsPerDim;
+				pTriangle[ 2 ] = corner + 1;
+				pTriangle[ 3 ] = corner + 1;
+				pTriangle[ 4 ] = corner + prtsPerDim;
+				pTriangle[ 5 ] = corner + prtsPerDim + 1;
+				pTriangle += 6;
+			}
+		}
+
+		//the same seed every run, so the results compare
+		if( i == 2 )
+		{
+			DWORD seed = 12345;
+			for( int t = numTriangles - 1; t > 0; --t )
+			{
+				seed = seed * 1664525 + 1013904223;
+				const int other = int( ( seed >> 8 ) % DWORD( t + 1 ) );
+				std::swap_ranges( &triangles[ t * 3 ], &triangles[ t * 3 ] + 3,
+								  &triangles[ other * 3 ] );
+			}
+		}
+
+		const double start = GetSeconds();
+		indices.Build( &triangles[ 0 ], numTriangles, prtsPerDim * prtsPerDim );
+
+		IndexBenchmark& result = pResults[ i ];
+		result.buildMs			= float( ( GetSeconds() - start ) * 1000.0 );
+		result.name				= ORDER_NAMES[ i ];
+		result.numTriangles		= numTriangles;
+		result.numChunks		= indices.GetNumChunks();
+		result.is16Bit			= indices.Is16Bit();
+		result.sourceACMR		= indices.GetSourceACMR();
+		result.optimisedACMR	= indices.GetOptimisedACMR();
+	}
+
+	return numResults;
+}
@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// File: ClothBenchmark.h
+// Desc: Measures what each integrator storage format costs and saves, and
+//		 how the index lists chunk
+//
+// Created: 18 October 2026 16:30:46
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_CLOTHBENCHMARK_H
+#define INCLUSIONGUARD_CLOTHBENCHMARK_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <windows.h>
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: struct IntegratorBenchmark
+// Desc: The results for one integrator
+//------------------------------------------------------------------------------
+struct IntegratorBenchmark
+{
+	const char*	name;
+	int			stateBytes;		//old position storage per particle
+	int			scratchBytes;	//more per particle, passed from step to commit
+	size_t		arenaBytes;		//the whole cloth
+	float		integrateNs;	//per particle, integration alone, out of cache
+	float		stepMs;			//per whole time step of the cloth
+	float		maxDrift;		//furthest a particle strays from double, double
+};
+
+//times every integrator in the registry, first on its own over more particles
+//than the cache holds and then stepping a whole grid cloth for numSteps,
+//against the double precision cloth. Returns the number of results written.
+int RunIntegratorBenchmark( const int prtsPerDim, const int numSteps,
+							IntegratorBenchmark* pResults, const int maxResults );
+
+//------------------------------------------------------------------------------
+// Name: struct IndexBenchmark
+// Desc: How one triangle order of a grid splits into index chunks
+//------------------------------------------------------------------------------
+struct IndexBenchmark
+{
+	const char*	name;
+	int			numTriangles;
+	int			numChunks;		//draw calls needed
+	bool		is16Bit;
+	float		sourceACMR;		//vertices transformed per triangle, as given
+	float		optimisedACMR;	//and once reordered
+	float		buildMs;
+};
+
+//builds the index list of a prtsPerDim square grid from its triangles in
+//row order, column order and shuffled, as meshes from other tools arrive.
+//Returns the number of results written.
+int RunIndexBenchmark( const int prtsPerDim, IndexBenchmark* pResults,
+					   const int maxResults );
+
+
+#endif //INCLUSIONGUARD_CLOTHBENCHMARK_H
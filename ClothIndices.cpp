@@ -0,0 +1,604 @@
+//------------------------------------------------------------------------------
+// File: ClothIndices.cpp
+// Desc: Cached, vertex cache optimised index lists for the cloth triangles
+//
+// Created: 18 October 2026 15:32:47
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "ClothIndices.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: struct TriangleSpan
+// Desc: The range of vertices one triangle uses, sorted by its lowest vertex
+//------------------------------------------------------------------------------
+struct TriangleSpan
+{
+	int lowest;
+	int highest;
+	int triangle;
+
+	bool operator<( const TriangleSpan& rhs ) const
+	{
+		if( lowest != rhs.lowest )
+			return lowest < rhs.lowest;
+		return triangle < rhs.triangle;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Name: GetVertexScore()
+// Desc: How much the cache optimiser wants to use a vertex next - recently
+//		 used vertices are cheap, and vertices with few triangles left should
+//		 be finished off before they are evicted
+//------------------------------------------------------------------------------
+static float GetVertexScore( const int cachePosition, const int remaining )
+{
+	const int CACHE_SIZE = ClothIndices::OPTIMISE_CACHE_SIZE;
+
+	if( remaining == 0 )
+		return -1.0f;
+
+	float score = 0.0f;
+	if( cachePosition >= 0 )
+	{
+		//the last triangle's vertices score the same, so any order works
+		if( cachePosition < 3 )
+			score = 0.75f;
+		else
+			score = float( pow( 1.0f - float( cachePosition - 3 ) / ( CACHE_SIZE - 3 ),
+								1.5f ) );
+	}
+
+	score += 2.0f / float( sqrt( float( remaining ) ) );
+	return score;
+}
+
+//------------------------------------------------------------------------------
+// Name: ClothIndices()
+// Desc: Constructor for the index list
+//------------------------------------------------------------------------------
+ClothIndices::ClothIndices()
+{
+	m_numTriangles	= 0;
+	m_is16Bit		= true;
+	m_sourceACMR	= 0.0f;
+	m_optimisedACMR	= 0.0f;
+	m_dirtyFirst	= 0;
+	m_dirtyLast		= -1;
+}
+
+//------------------------------------------------------------------------------
+// Name: ~ClothIndices()
+// Desc: Destructor for the index list
+//------------------------------------------------------------------------------
+ClothIndices::~ClothIndices()
+{
+}
+
+//------------------------------------------------------------------------------
+// Name: Build()
+// Desc: Splits the triangles into chunks of less than 64k vertices, reorders
+//		 each chunk for the vertex cache and stores the smallest index format
+//		 that fits. Only the topology is used, so this is done once per cloth.
+//		 Chunks are cut by vertex range rather than in source triangle order,
+//		 so a mesh exported in any order still gets a few large chunks.
+//------------------------------------------------------------------------------
+void ClothIndices::Build( const int* pTriangles, const int numTriangles,
+						  const int numVertices )
+{
+	m_numTriangles	= numTriangles;
+	m_sourceACMR	= MeasureACMR( pTriangles, numTriangles );
+
+	m_chunks.clear();
+	m_indices16.clear();
+	m_indices32.clear();
+	m_triangleSlot.resize( numTriangles );
+	m_slotTriangle.resize( numTriangles );
+
+	//a new list has to go to the index buffer in full
+	m_dirtyFirst	= 0;
+	m_dirtyLast		= numTriangles * 3 - 1;
+
+	std::vector< int > work( numTriangles * 3 );
+	std::vector< int > order( numTriangles );
+	std::vector< int > source;		//source triangle in each slot
+	source.reserve( numTriangles );
+
+	//sort the triangles by the lowest vertex they use
+	std::vector< TriangleSpan > pending( numTriangles );
+	for( int t = 0; t < numTriangles; ++t )
+	{
+		const int* pCorners = pTriangles + t * 3;
+		pending[ t ].lowest		= std::min( pCorners[ 0 ], std::min( pCorners[ 1 ], pCorners[ 2 ] ) );
+		pending[ t ].highest	= std::max( pCorners[ 0 ], std::max( pCorners[ 1 ], pCorners[ 2 ] ) );
+		pending[ t ].triangle	= t;
+	}
+	std::sort( pending.begin(), pending.end() );
+
+	//each chunk takes the triangles starting in a 64k window of vertices -
+	//particles close in memory are close on the cloth, so it covers a
+	//compact area. A narrow triangle that reaches past the window ends the
+	//chunk, as the next chunk starts with it and still spans half a window.
+	//A wide one would leave a small chunk behind, so it is put off to a
+	//later pass where the wide triangles share windows of their own.
+	std::vector< TriangleSpan > deferred;
+	m_is16Bit = true;
+	while( !pending.empty() && m_is16Bit )
+	{
+		deferred.clear();
+
+		for( size_t i = 0; i < pending.size(); )
+		{
+			const int baseVertex = pending[ i ].lowest;
+
+			//a single triangle too big for any chunk needs 32-bit indices
+			if( pending[ i ].highest - baseVertex + 1 > MAX_CHUNK_VERTICES )
+			{
+				m_is16Bit = false;
+				break;
+			}
+
+			IndexChunk chunk;
+			chunk.firstIndex	= int( source.size() ) * 3;
+			chunk.baseVertex	= baseVertex;
+			int highest			= baseVertex;
+
+			for( ; i < pending.size() && pending[ i ].lowest - baseVertex < MAX_CHUNK_VERTICES; ++i )
+			{
+				if( pending[ i ].highest - baseVertex + 1 > MAX_CHUNK_VERTICES )
+				{
+					if( pending[ i ].highest - pending[ i ].lowest < MAX_CHUNK_VERTICES / 2 )
+						break;
+
+					deferred.push_back( pending[ i ] );
+					continue;
+				}
+
+				highest = std::max( highest, pending[ i ].highest );
+				source.push_back( pending[ i ].triangle );
+			}
+
+			chunk.numTriangles	= int( source.size() ) - chunk.firstIndex / 3;
+			chunk.numVertices	= highest - baseVertex + 1;
+			m_chunks.push_back( chunk );
+		}
+
+		pending.swap( deferred );
+	}
+
+	if( m_is16Bit )
+	{
+		//lay the triangles out chunk by chunk
+		for( int slot = 0; slot < numTriangles; ++slot )
+			for( int corner = 0; corner < 3; ++corner )
+				work[ slot * 3 + corner ] = pTriangles[ source[ slot ] * 3 + corner ];
+
+		m_indices16.resize( numTriangles * 3 );
+
+		for( size_t c = 0; c < m_chunks.size(); ++c )
+		{
+			const IndexChunk& chunk = m_chunks[ c ];
+			const int firstTriangle = chunk.firstIndex / 3;
+			int* pChunk = &work[ chunk.firstIndex ];
+
+			for( int i = 0; i < chunk.numTriangles * 3; ++i )
+				pChunk[ i ] -= chunk.baseVertex;
+
+			OptimiseChunk( pChunk, &order[ firstTriangle ], chunk.numTriangles,
+						   chunk.numVertices );
+
+			for( int t = 0; t < chunk.numTriangles; ++t )
+			{
+				const int triangle = source[ firstTriangle + order[ firstTriangle + t ] ];
+				m_triangleSlot[ triangle ]				= firstTriangle + t;
+				m_slotTriangle[ firstTriangle + t ]	= triangle;
+			}
+
+			for( int i = 0; i < chunk.numTriangles * 3; ++i )
+			{
+				m_indices16[ chunk.firstIndex + i ] = WORD( pChunk[ i ] );
+				pChunk[ i ] += chunk.baseVertex;
+			}
+		}
+	}
+	else
+	{
+		//one 32-bit chunk covering everything
+		m_chunks.clear();
+
+		IndexChunk chunk;
+		chunk.firstIndex	= 0;
+		chunk.numTriangles	= numTriangles;
+		chunk.baseVertex	= 0;
+		chunk.numVertices	= numVertices;
+		m_chunks.push_back( chunk );
+
+		std::copy( pTriangles, pTriangles + numTriangles * 3, work.begin() );
+		if( numTriangles > 0 )
+			OptimiseChunk( &work[ 0 ], &order[ 0 ], numTriangles, numVertices );
+
+		for( int t = 0; t < numTriangles; ++t )
+		{
+			m_triangleSlot[ order[ t ] ]	= t;
+			m_slotTriangle[ t ]				= order[ t ];
+		}
+
+		m_indices32.resize( numTriangles * 3 );
+		for( int i = 0; i < numTriangles * 3; ++i )
+			m_indices32[ i ] = DWORD( work[ i ] );
+	}
+
+	m_optimisedACMR = MeasureACMR( numTriangles > 0 ? &work[ 0 ] : NULL, numTriangles );
+}
+
+//------------------------------------------------------------------------------
+// Name: FillIndexBuffer()
+// Desc: Copies the cached index list into an index buffer
+//------------------------------------------------------------------------------
+HRESULT ClothIndices::FillIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB ) const
+{
+	//lock the buffer
+	void* pBuffer = NULL;
+	if( FAILED( pIB->Lock( 0, GetSizeInBytes(), &pBuffer, 0 ) ) )
+		return( E_FAIL );
+
+	memcpy( pBuffer, GetData(), GetSizeInBytes() );
+
+	//unlock the buffer
+	pIB->Unlock();
+
+	return S_OK;
+}
+
+//------------------------------------------------------------------------------
+// Name: UpdateTriangle()
+// Desc: Patches the three indices of one triangle in place, for topology
+//		 changes that keep the triangle count. A triangle that no longer fits
+//		 its chunk's 16-bit window is moved out of that chunk alone.
+//------------------------------------------------------------------------------
+bool ClothIndices::UpdateTriangle( const int triangle, const int* pCorners )
+{
+	int slot = m_triangleSlot[ triangle ];
+
+	if( m_is16Bit )
+	{
+		const int lowest	= std::min( pCorners[ 0 ], std::min( pCorners[ 1 ], pCorners[ 2 ] ) );
+		const int highest	= std::max( pCorners[ 0 ], std::max( pCorners[ 1 ], pCorners[ 2 ] ) );
+		if( highest - lowest + 1 > MAX_CHUNK_VERTICES )
+			return false;
+
+		int c = FindChunk( slot );
+		if( !FitsChunk( m_chunks[ c ], lowest, highest ) )
+		{
+			c		= SpillTriangle( c, slot, lowest, highest );
+			slot	= m_triangleSlot[ triangle ];
+		}
+
+		IndexChunk& chunk = m_chunks[ c ];
+		chunk.numVertices = std::max( chunk.numVertices, highest - chunk.baseVertex + 1 );
+		for( int corner = 0; corner < 3; ++corner )
+			m_indices16[ slot * 3 + corner ] = WORD( pCorners[ corner ] - chunk.baseVertex );
+	}
+	else
+	{
+		IndexChunk& chunk = m_chunks[ 0 ];
+		for( int corner = 0; corner < 3; ++corner )
+		{
+			m_indices32[ slot * 3 + corner ] = DWORD( pCorners[ corner ] );
+			chunk.numVertices = std::max( chunk.numVertices, pCorners[ corner ] + 1 );
+		}
+	}
+
+	MarkDirty( slot );
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: FindChunk()
+// Desc: Returns the chunk holding a triangle slot
+//------------------------------------------------------------------------------
+int ClothIndices::FindChunk( const int slot ) const
+{
+	int c = 0;
+	while( c + 1 < int( m_chunks.size() ) && m_chunks[ c + 1 ].firstIndex <= slot * 3 )
+		++c;
+
+	return c;
+}
+
+//------------------------------------------------------------------------------
+// Name: FitsChunk()
+// Desc: Does a range of vertices fit in a chunk's 16-bit window?
+//------------------------------------------------------------------------------
+bool ClothIndices::FitsChunk( const IndexChunk& chunk, const int lowest,
+							  const int highest ) const
+{
+	return lowest >= chunk.baseVertex &&
+		   highest - chunk.baseVertex < MAX_CHUNK_VERTICES;
+}
+
+//------------------------------------------------------------------------------
+// Name: SpillTriangle()
+// Desc: Swaps a triangle that has outgrown its chunk into the chunk's last
+//		 slot and hands that slot to the next chunk, if its window can take
+//		 the triangle, or else to a new chunk of its own. Only the two slots
+//		 change. Returns the chunk now holding the triangle.
+//------------------------------------------------------------------------------
+int ClothIndices::SpillTriangle( const int chunk, const int slot, const int lowest,
+								 const int highest )
+{
+	const int last = m_chunks[ chunk ].firstIndex / 3 + m_chunks[ chunk ].numTriangles - 1;
+	if( slot != last )
+	{
+		for( int corner = 0; corner < 3; ++corner )
+			std::swap( m_indices16[ slot * 3 + corner ], m_indices16[ last * 3 + corner ] );
+
+		std::swap( m_slotTriangle[ slot ], m_slotTriangle[ last ] );
+		m_triangleSlot[ m_slotTriangle[ slot ] ] = slot;
+		m_triangleSlot[ m_slotTriangle[ last ] ] = last;
+		MarkDirty( slot );
+	}
+	--m_chunks[ chunk ].numTriangles;
+
+	int to = chunk + 1;
+	if( to < int( m_chunks.size() ) && FitsChunk( m_chunks[ to ], lowest, highest ) )
+	{
+		m_chunks[ to ].firstIndex -= 3;
+		++m_chunks[ to ].numTriangles;
+	}
+	else
+	{
+		IndexChunk spill;
+		spill.firstIndex	= last * 3;
+		spill.numTriangles	= 1;
+		spill.baseVertex	= lowest;
+		spill.numVertices	= highest - lowest + 1;
+		m_chunks.insert( m_chunks.begin() + to, spill );
+	}
+
+	//a chunk left empty is not drawn
+	if( m_chunks[ chunk ].numTriangles == 0 )
+	{
+		m_chunks.erase( m_chunks.begin() + chunk );
+		--to;
+	}
+
+	return to;
+}
+
+//------------------------------------------------------------------------------
+// Name: MarkDirty()
+// Desc: Grows the range waiting to go to the index buffer to cover a slot
+//------------------------------------------------------------------------------
+void ClothIndices::MarkDirty( const int slot )
+{
+	if( IsDirty() )
+	{
+		m_dirtyFirst	= std::min( m_dirtyFirst, slot * 3 );
+		m_dirtyLast		= std::max( m_dirtyLast, slot * 3 + 2 );
+	}
+	else
+	{
+		m_dirtyFirst	= slot * 3;
+		m_dirtyLast		= slot * 3 + 2;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: UpdateIndexBuffer()
+// Desc: Copies only the indices changed since the last update
+//------------------------------------------------------------------------------
+HRESULT ClothIndices::UpdateIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB )
+{
+	if( !IsDirty() )
+		return S_OK;
+
+	const int offset	= m_dirtyFirst * GetIndexSize();
+	const int size		= ( m_dirtyLast - m_dirtyFirst + 1 ) * GetIndexSize();
+
+	//lock the buffer
+	void* pBuffer = NULL;
+	if( FAILED( pIB->Lock( offset, size, &pBuffer, 0 ) ) )
+		return( E_FAIL );
+
+	memcpy( pBuffer, (const BYTE*)GetData() + offset, size );
+
+	//unlock the buffer
+	pIB->Unlock();
+
+	m_dirtyFirst	= 0;
+	m_dirtyLast		= -1;
+
+	return S_OK;
+}
+
+//------------------------------------------------------------------------------
+// Name: GetData()
+// Desc: Returns the finished index list
+//------------------------------------------------------------------------------
+const void* ClothIndices::GetData() const
+{
+	if( m_numTriangles == 0 )
+		return NULL;
+
+	if( m_is16Bit )
+		return &m_indices16[ 0 ];
+	return &m_indices32[ 0 ];
+}
+
+//------------------------------------------------------------------------------
+// Name: OptimiseChunk()
+// Desc: Reorders triangles for the post-transform vertex cache, using Tom
+//		 Forsyth's greedy linear-speed algorithm. Each step emits the triangle
+//		 whose vertices score highest, then rescores only what is in the cache.
+//		 pOrder receives the original number of each emitted triangle.
+//------------------------------------------------------------------------------
+void ClothIndices::OptimiseChunk( int* pTriangles, int* pOrder, const int numTriangles,
+								  const int numVertices )
+{
+	const int CACHE_SIZE = OPTIMISE_CACHE_SIZE;
+	if( numTriangles == 0 )
+		return;
+
+	//build the triangle lists for each vertex
+	std::vector< int > remaining( numVertices, 0 );
+	for( int i = 0; i < numTriangles * 3; ++i )
+		++remaining[ pTriangles[ i ] ];
+
+	std::vector< int > firstTriangle( numVertices + 1, 0 );
+	for( int v = 0; v < numVertices; ++v )
+		firstTriangle[ v + 1 ] = firstTriangle[ v ] + remaining[ v ];
+
+	std::vector< int > vertexTriangles( numTriangles * 3 );
+	std::vector< int > fill( firstTriangle.begin(), firstTriangle.end() - 1 );
+	for( int t = 0; t < numTriangles; ++t )
+		for( int corner = 0; corner < 3; ++corner )
+			vertexTriangles[ fill[ pTriangles[ t * 3 + corner ] ]++ ] = t;
+
+	//score everything
+	std::vector< int > cachePosition( numVertices, -1 );
+	std::vector< float > vertexScore( numVertices );
+	for( int v = 0; v < numVertices; ++v )
+		vertexScore[ v ] = GetVertexScore( -1, remaining[ v ] );
+
+	std::vector< float > triangleScore( numTriangles );
+	std::vector< bool > emitted( numTriangles, false );
+	for( int t = 0; t < numTriangles; ++t )
+		triangleScore[ t ] = vertexScore[ pTriangles[ t * 3 ] ] +
+							 vertexScore[ pTriangles[ t * 3 + 1 ] ] +
+							 vertexScore[ pTriangles[ t * 3 + 2 ] ];
+
+	std::vector< int > output;
+	output.reserve( numTriangles * 3 );
+
+	int cache[ CACHE_SIZE + 3 ];
+	int cacheSize = 0;
+	int bestTriangle = -1;
+	int nextUnemitted = 0;
+
+	for( int step = 0; step < numTriangles; ++step )
+	{
+		//with nothing in the cache worth using, carry on in source order
+		if( bestTriangle < 0 )
+		{
+			while( emitted[ nextUnemitted ] )
+				++nextUnemitted;
+			bestTriangle = nextUnemitted;
+		}
+
+		//emit the triangle and take it out of its vertices' lists
+		const int* pBest = &pTriangles[ bestTriangle * 3 ];
+		emitted[ bestTriangle ] = true;
+		pOrder[ step ] = bestTriangle;
+
+		int newCache[ CACHE_SIZE + 3 ];
+		int newCacheSize = 0;
+
+		for( int corner = 0; corner < 3; ++corner )
+		{
+			const int v = pBest[ corner ];
+			output.push_back( v );
+
+			int* pList = &vertexTriangles[ firstTriangle[ v ] ];
+			for( int i = 0; i < remaining[ v ]; ++i )
+			{
+				if( pList[ i ] == bestTriangle )
+				{
+					std::swap( pList[ i ], pList[ remaining[ v ] - 1 ] );
+					break;
+				}
+			}
+			--remaining[ v ];
+
+			if( std::find( newCache, newCache + newCacheSize, v ) == newCache + newCacheSize )
+				newCache[ newCacheSize++ ] = v;
+		}
+
+		//push the rest of the old cache back behind the new vertices
+		for( int i = 0; i < cacheSize && newCacheSize < CACHE_SIZE + 3; ++i )
+		{
+			if( std::find( newCache, newCache + newCacheSize, cache[ i ] ) ==
+				newCache + newCacheSize )
+				newCache[ newCacheSize++ ] = cache[ i ];
+		}
+
+		//rescore the cached vertices, letting the overflow drop out
+		for( int i = 0; i < newCacheSize; ++i )
+		{
+			const int v = newCache[ i ];
+			cachePosition[ v ]	= ( i < CACHE_SIZE ) ? i : -1;
+			vertexScore[ v ]	= GetVertexScore( cachePosition[ v ], remaining[ v ] );
+		}
+
+		//rescore their triangles and pick the best for next time
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for( int i = 0; i < newCacheSize; ++i )
+		{
+			const int v = newCache[ i ];
+			const int* pList = &vertexTriangles[ firstTriangle[ v ] ];
+
+			for( int j = 0; j < remaining[ v ]; ++j )
+			{
+				const int t = pList[ j ];
+				triangleScore[ t ] = vertexScore[ pTriangles[ t * 3 ] ] +
+									 vertexScore[ pTriangles[ t * 3 + 1 ] ] +
+									 vertexScore[ pTriangles[ t * 3 + 2 ] ];
+				if( triangleScore[ t ] > bestScore )
+				{
+					bestScore		= triangleScore[ t ];
+					bestTriangle	= t;
+				}
+			}
+		}
+
+		cacheSize = std::min( newCacheSize, int( CACHE_SIZE ) );
+		for( int i = 0; i < cacheSize; ++i )
+			cache[ i ] = newCache[ i ];
+	}
+
+	std::copy( output.begin(), output.end(), pTriangles );
+}
+
+//------------------------------------------------------------------------------
+// Name: MeasureACMR()
+// Desc: Runs a triangle list through a FIFO vertex cache and returns the
+//		 number of vertices transformed per triangle
+//------------------------------------------------------------------------------
+float ClothIndices::MeasureACMR( const int* pTriangles, const int numTriangles )
+{
+	if( numTriangles == 0 )
+		return 0.0f;
+
+	int cache[ MEASURE_CACHE_SIZE ];
+	int cacheSize = 0, next = 0, misses = 0;
+
+	for( int i = 0; i < numTriangles * 3; ++i )
+	{
+		const int v = pTriangles[ i ];
+		if( std::find( cache, cache + cacheSize, v ) != cache + cacheSize )
+			continue;
+
+		++misses;
+		cache[ next ] = v;
+		next = ( next + 1 ) % MEASURE_CACHE_SIZE;
+		cacheSize = std::min( cacheSize + 1, int( MEASURE_CACHE_SIZE ) );
+	}
+
+	return float( misses ) / float( numTriangles );
+}
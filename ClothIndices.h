@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// File: ClothIndices.h
+// Desc: Cached, vertex cache optimised index lists for the cloth triangles
+//
+// Created: 18 October 2026 15:32:47
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_CLOTHINDICES_H
+#define INCLUSIONGUARD_CLOTHINDICES_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <vector>
+#include <d3dx9.h>
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: struct IndexChunk
+// Desc: A run of triangles drawable with one DrawIndexedPrimitive call
+//------------------------------------------------------------------------------
+struct IndexChunk
+{
+	int firstIndex;		//first index in the list
+	int numTriangles;	//triangles in this chunk
+	int baseVertex;		//added to every index in this chunk
+	int numVertices;	//span of vertices used, from baseVertex
+};
+
+//------------------------------------------------------------------------------
+// Name: class ClothIndices
+// Desc: Builds the index list for a fixed triangle topology once. Indices are
+//		 16-bit whenever each chunk spans fewer than 65535 vertices, and the
+//		 triangles in each chunk are reordered for post-transform cache reuse.
+//------------------------------------------------------------------------------
+class ClothIndices
+{
+public:
+	const static int MAX_CHUNK_VERTICES = 0xffff;
+	const static int OPTIMISE_CACHE_SIZE = 32;	//cache modelled while reordering
+	const static int MEASURE_CACHE_SIZE = 16;	//FIFO cache used for ACMR figures
+
+	ClothIndices();
+	~ClothIndices();
+
+	void Build( const int* pTriangles, const int numTriangles, const int numVertices );
+
+	//replaces the corners of one source triangle. One that outgrows its
+	//chunk moves to a neighbouring chunk; false means it spans too many
+	//vertices for any chunk and the list must be rebuilt.
+	bool UpdateTriangle( const int triangle, const int* pCorners );
+
+	HRESULT FillIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB ) const;
+	HRESULT UpdateIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB );
+	bool IsDirty() const { return m_dirtyFirst <= m_dirtyLast; }
+
+	//the finished index list, as plain memory
+	const void* GetData() const;
+	int GetSizeInBytes() const { return GetNumIndices() * GetIndexSize(); }
+	int GetIndexSize() const { return m_is16Bit ? sizeof( WORD ) : sizeof( DWORD ); }
+	int GetNumIndices() const { return m_numTriangles * 3; }
+	bool Is16Bit() const { return m_is16Bit; }
+	D3DFORMAT GetFormat() const { return m_is16Bit ? D3DFMT_INDEX16 : D3DFMT_INDEX32; }
+
+	int GetNumChunks() const { return int( m_chunks.size() ); }
+	const IndexChunk& GetChunk( const int chunk ) const { return m_chunks[ chunk ]; }
+
+	//average cache miss ratio - transformed vertices per triangle
+	float GetSourceACMR() const { return m_sourceACMR; }
+	float GetOptimisedACMR() const { return m_optimisedACMR; }
+
+private:
+	static void OptimiseChunk( int* pTriangles, int* pOrder, const int numTriangles,
+							   const int numVertices );
+	static float MeasureACMR( const int* pTriangles, const int numTriangles );
+
+	int FindChunk( const int slot ) const;
+	bool FitsChunk( const IndexChunk& chunk, const int lowest, const int highest ) const;
+	int SpillTriangle( const int chunk, const int slot, const int lowest, const int highest );
+	void MarkDirty( const int slot );
+
+	int m_numTriangles;
+	bool m_is16Bit;
+
+	std::vector< WORD >			m_indices16;
+	std::vector< DWORD >		m_indices32;
+	std::vector< IndexChunk >	m_chunks;
+	std::vector< int >			m_triangleSlot;	//where each source triangle went
+	std::vector< int >			m_slotTriangle;	//and which one each slot holds
+
+	//range of indices changed since the index buffer was last updated
+	int m_dirtyFirst;
+	int m_dirtyLast;
+
+	float m_sourceACMR;
+	float m_optimisedACMR;
+};
+
+
+#endif //INCLUSIONGUARD_CLOTHINDICES_H
@@ -0,0 +1,275 @@
+//------------------------------------------------------------------------------
+// File: ClothLOD.cpp
+// Desc: Resolution levels of one cloth, picked by size on screen
+//
+// Created: 18 October 2026 15:57:28
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <math.h>
+#include <algorithm>
+#include "ClothLOD.h"
+#include "ParticleSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+const float ClothLOD::PIXELS_PER_PARTICLE = 4.0f;
+const float ClothLOD::REFINE_CURVATURE = 0.3f;
+const float ClothLOD::COARSEN_MARGIN = 1.25f;
+
+//------------------------------------------------------------------------------
+// Name: ClothLOD()
+// Desc: Constructor for a grid cloth, halving the resolution at each level
+//------------------------------------------------------------------------------
+ClothLOD::ClothLOD( const int prtsPerDim, const int numLevels, JobSystem* pJobs,
+					const IntegratorStorage storage )
+{
+	m_numLevels		= 0;
+	m_activeLevel	= 0;
+	m_screenSize	= 0.0f;
+
+	int levelPrtsPerDim = prtsPerDim;
+	while( m_numLevels < std::min( numLevels, int( MAX_LEVELS ) ) &&
+		   ( m_numLevels == 0 || levelPrtsPerDim >= MIN_PRTS_PER_DIM ) )
+	{
+		m_pLevels[ m_numLevels++ ] = new ParticleSystem( levelPrtsPerDim, pJobs, storage );
+		levelPrtsPerDim /= 2;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: ClothLOD()
+// Desc: Constructor for a mesh cloth, which has just the one level
+//------------------------------------------------------------------------------
+ClothLOD::ClothLOD( const ClothMesh& mesh, JobSystem* pJobs, const IntegratorStorage storage )
+{
+	m_pLevels[ 0 ]	= new ParticleSystem( mesh, pJobs, storage );
+	m_numLevels		= 1;
+	m_activeLevel	= 0;
+	m_screenSize	= 0.0f;
+}
+
+//------------------------------------------------------------------------------
+// Name: ~ClothLOD()
+// Desc: Destructor for the cloth levels
+//------------------------------------------------------------------------------
+ClothLOD::~ClothLOD()
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		delete m_pLevels[ level ];
+}
+
+//------------------------------------------------------------------------------
+// Name: Initialise()
+// Desc: Resets every level of the cloth
+//------------------------------------------------------------------------------
+void ClothLOD::Initialise()
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->Initialise();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetTimeStep()
+// Desc: Sets the time step of every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetTimeStep( const float timeStep )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetTimeStep( timeStep );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetNumIterations()
+// Desc: Sets the solver iteration count of every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetNumIterations( const int numIterations )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetNumIterations( numIterations );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetTearing()
+// Desc: Turns tearing on or off for every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetTearing( const bool enable )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetTearing( enable );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetPinned()
+// Desc: Pins every level where it is now, or frees it. A grid hangs from the
+//		 two corners of its first row; a mesh has no corners, so it hangs
+//		 from the particle nearest its middle.
+//------------------------------------------------------------------------------
+void ClothLOD::SetPinned( const bool pinned )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+	{
+		ParticleSystem* const pLevel = m_pLevels[ level ];
+		pLevel->ClearAnchors();
+		if( !pinned )
+			continue;
+
+		if( pLevel->IsGrid() )
+		{
+			pLevel->SetAnchor( 0, true );
+			pLevel->SetAnchor( pLevel->GetPrtsPerDim() - 1, true );
+		}
+		else
+			pLevel->SetAnchor( pLevel->GetConstraintParticle(), true );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: SetSolver()
+// Desc: Picks the constraint solver for every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetSolver( const ConstraintSolver solver )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetSolver( solver );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetOverRelaxation()
+// Desc: Sets the projection solver's over-relaxation factor for every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetOverRelaxation( const float factor )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetOverRelaxation( factor );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetChebyshev()
+// Desc: Turns Chebyshev extrapolation on or off for every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetChebyshev( const bool enable )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetChebyshev( enable );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetNumSubsteps()
+// Desc: Sets the substeps per time step for every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetNumSubsteps( const int numSubsteps )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetNumSubsteps( numSubsteps );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetTileDim()
+// Desc: Recuts every level into tiles of the given size
+//------------------------------------------------------------------------------
+void ClothLOD::SetTileDim( const int tileDim )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetTileDim( tileDim );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetSpecialisation()
+// Desc: Allows or rules out the specialised grid kernels for every level
+//------------------------------------------------------------------------------
+void ClothLOD::SetSpecialisation( const bool enable )
+{
+	for( int level = 0; level < m_numLevels; ++level )
+		m_pLevels[ level ]->SetSpecialisation( enable );
+}
+
+//------------------------------------------------------------------------------
+// Name: GetMaxParticles()
+// Desc: Returns the most particles any level can have, for sizing buffers
+//------------------------------------------------------------------------------
+int ClothLOD::GetMaxParticles() const
+{
+	int maxParticles = 0;
+	for( int level = 0; level < m_numLevels; ++level )
+		maxParticles = std::max( maxParticles, m_pLevels[ level ]->GetMaxParticles() );
+
+	return maxParticles;
+}
+
+//------------------------------------------------------------------------------
+// Name: ChooseLevel()
+// Desc: Returns the finest level whose particles are still PIXELS_PER_PARTICLE
+//		 apart at the given size on screen
+//------------------------------------------------------------------------------
+int ClothLOD::ChooseLevel( const float screenSize ) const
+{
+	for( int level = 0; level < m_numLevels - 1; ++level )
+	{
+		const int spans = m_pLevels[ level ]->GetPrtsPerDim() - 1;
+		if( spans * PIXELS_PER_PARTICLE <= screenSize )
+			return level;
+	}
+
+	return m_numLevels - 1;
+}
+
+//------------------------------------------------------------------------------
+// Name: Update()
+// Desc: Projects the cloth's bounds to find its size on screen and moves to
+//		 the level that suits it. Sharp folds hold or raise the resolution,
+//		 and a torn cloth stays where it is, as tears cannot be resampled.
+//------------------------------------------------------------------------------
+bool ClothLOD::Update( const D3DXVECTOR3& vEyePt, const float fovY,
+					   const float screenHeight )
+{
+	ParticleSystem* const pActive = GetActive();
+
+	//size of the bounding sphere on screen
+	D3DXVECTOR3 vMin, vMax;
+	pActive->GetBounds( vMin, vMax );
+
+	D3DXVECTOR3 vExtent = ( vMax - vMin ) * 0.5f;
+	D3DXVECTOR3 vDelta	= ( vMin + vExtent ) - vEyePt;
+	const float radius		= D3DXVec3Length( &vExtent );
+	const float distance	= D3DXVec3Length( &vDelta );
+
+	if( distance <= radius )
+		m_screenSize = screenHeight;
+	else
+		m_screenSize = radius * screenHeight / ( distance * float( tan( fovY * 0.5f ) ) );
+
+	if( m_numLevels == 1 || pActive->IsTorn() )
+		return false;
+
+	int level = ChooseLevel( m_screenSize );
+	const float curvature = pActive->GetCurvature();
+
+	if( curvature > REFINE_CURVATURE )
+	{
+		//step up one level at a time while the fold lasts
+		level = std::min( level, std::max( m_activeLevel - 1, 0 ) );
+	}
+	else if( level > m_activeLevel )
+	{
+		//only coarsen once the fold has relaxed and the cloth is clearly smaller
+		if( curvature > REFINE_CURVATURE * 0.5f ||
+			ChooseLevel( m_screenSize * COARSEN_MARGIN ) <= m_activeLevel )
+			level = m_activeLevel;
+	}
+
+	if( level == m_activeLevel )
+		return false;
+
+	m_pLevels[ level ]->Resample( *pActive );
+	m_activeLevel = level;
+	return true;
+}
@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// File: ClothLOD.h
+// Desc: Resolution levels of one cloth, picked by size on screen
+//
+// Created: 18 October 2026 15:57:28
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_CLOTHLOD_H
+#define INCLUSIONGUARD_CLOTHLOD_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <d3dx9.h>
+#include "ParticleSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+class JobSystem;
+struct ClothMesh;
+
+//------------------------------------------------------------------------------
+// Name: class ClothLOD
+// Desc: A cloth simulated at one of several grid resolutions. Level 0 is the
+//		 finest, and each level after it has half the particles per side. Only
+//		 the active level is stepped; on a switch the new level resamples the
+//		 old one's state.
+//------------------------------------------------------------------------------
+class ClothLOD
+{
+public:
+	const static int MAX_LEVELS = 4;
+	const static int MIN_PRTS_PER_DIM = 8;
+	const static float PIXELS_PER_PARTICLE;	//particle spacing on screen to aim for
+	const static float REFINE_CURVATURE;	//fold that asks for the next finer level
+	const static float COARSEN_MARGIN;		//how clearly a cloth must shrink to coarsen
+
+	ClothLOD( const int prtsPerDim, const int numLevels = MAX_LEVELS,
+			  JobSystem* pJobs = NULL, const IntegratorStorage storage = STORE_FLOAT );
+	ClothLOD( const ClothMesh& mesh, JobSystem* pJobs = NULL,
+			  const IntegratorStorage storage = STORE_FLOAT );
+	~ClothLOD();
+
+	//picks the level for the cloth's size on screen, returning true on a switch
+	bool Update( const D3DXVECTOR3& vEyePt, const float fovY, const float screenHeight );
+
+	void Initialise();
+	void SetTimeStep( const float timeStep );
+	void SetNumIterations( const int numIterations );
+	void SetTearing( const bool enable );
+	void SetPinned( const bool pinned );
+	void SetSolver( const ConstraintSolver solver );
+	void SetOverRelaxation( const float factor );
+	void SetChebyshev( const bool enable );
+	void SetNumSubsteps( const int numSubsteps );
+	void SetTileDim( const int tileDim );
+	void SetSpecialisation( const bool enable );
+
+	ParticleSystem* GetActive() const { return m_pLevels[ m_activeLevel ]; }
+	ParticleSystem* GetLevel( const int level ) const { return m_pLevels[ level ]; }
+	int GetActiveLevel() const { return m_activeLevel; }
+	int GetNumLevels() const { return m_numLevels; }
+	int GetMaxParticles() const;
+	float GetScreenSize() const { return m_screenSize; }
+
+private:
+	int ChooseLevel( const float screenSize ) const;
+
+	ParticleSystem* m_pLevels[ MAX_LEVELS ];
+	int m_numLevels;
+	int m_activeLevel;
+	float m_screenSize;		//projected height of the cloth, in pixels
+};
+
+
+#endif //INCLUSIONGUARD_CLOTHLOD_H
@@ -0,0 +1,502 @@
+//------------------------------------------------------------------------------
+// File: ClothMesh.cpp
+// Desc: Arbitrary triangle mesh cloth topology and constraint generation
+//
+// Created: 18 October 2026 15:30:59
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "ClothMesh.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: struct MeshEdge
+// Desc: One side of one triangle, used to find shared edges
+//------------------------------------------------------------------------------
+struct MeshEdge
+{
+	int a, b;		//end particles, a < b
+	int opposite;	//the third particle of the triangle
+	bool longest;	//is this the longest side of its triangle?
+
+	bool operator<( const MeshEdge& rhs ) const
+	{
+		if( a != rhs.a )
+			return a < rhs.a;
+		return b < rhs.b;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Name: struct SortKey
+// Desc: An index with the value it is being sorted by
+//------------------------------------------------------------------------------
+struct SortKey
+{
+	DWORD key;
+	int index;
+
+	bool operator<( const SortKey& rhs ) const
+	{
+		if( key != rhs.key )
+			return key < rhs.key;
+		return index < rhs.index;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Name: ConstraintLess()
+// Desc: Orders constraints by particle, then by type
+//------------------------------------------------------------------------------
+static bool ConstraintLess( const ClothConstraint& lhs, const ClothConstraint& rhs )
+{
+	if( lhs.particleA != rhs.particleA )
+		return lhs.particleA < rhs.particleA;
+	if( lhs.particleB != rhs.particleB )
+		return lhs.particleB < rhs.particleB;
+	return lhs.type < rhs.type;
+}
+
+//------------------------------------------------------------------------------
+// Name: SameParticles()
+// Desc: Do two constraints join the same pair of particles?
+//------------------------------------------------------------------------------
+static bool SameParticles( const ClothConstraint& lhs, const ClothConstraint& rhs )
+{
+	return lhs.particleA == rhs.particleA && lhs.particleB == rhs.particleB;
+}
+
+//------------------------------------------------------------------------------
+// Name: MakeConstraint()
+// Desc: Builds a constraint holding two particles at their rest distance
+//------------------------------------------------------------------------------
+static ClothConstraint MakeConstraint( const ClothMesh& mesh, const int particleA,
+									   const int particleB, const int type )
+{
+	D3DXVECTOR3 vDelta = mesh.positions[ particleB ] - mesh.positions[ particleA ];
+
+	ClothConstraint c;
+	c.particleA		= ( particleA < particleB ) ? particleA : particleB;
+	c.particleB		= ( particleA < particleB ) ? particleB : particleA;
+	c.restLength	= D3DXVec3Length( &vDelta );
+	c.type			= type;
+
+	return c;
+}
+
+//------------------------------------------------------------------------------
+// Name: SpreadBits()
+// Desc: Spaces the low 10 bits of a value out to every third bit
+//------------------------------------------------------------------------------
+static DWORD SpreadBits( DWORD v )
+{
+	v &= 0x3ff;
+	v = ( v | ( v << 16 ) ) & 0x030000ff;
+	v = ( v | ( v << 8 ) ) & 0x0300f00f;
+	v = ( v | ( v << 4 ) ) & 0x030c30c3;
+	v = ( v | ( v << 2 ) ) & 0x09249249;
+	return v;
+}
+
+//------------------------------------------------------------------------------
+// Name: ParseObjIndex()
+// Desc: Turns a 1-based (or negative, relative) .obj index into a 0-based one
+//------------------------------------------------------------------------------
+static int ParseObjIndex( const int objIndex, const int count )
+{
+	if( objIndex < 0 )
+		return count + objIndex;
+	return objIndex - 1;
+}
+
+//------------------------------------------------------------------------------
+// Name: LoadClothMesh()
+// Desc: Loads a triangle mesh from a wavefront .obj file. Particles are keyed
+//		 on the position index, so pieces that share positions along a seam
+//		 are welded together. Triangles with a repeated corner are dropped,
+//		 and so are positions no triangle uses, which would otherwise be
+//		 particles with no constraints that fall forever.
+//------------------------------------------------------------------------------
+HRESULT LoadClothMesh( const char* filename, ClothMesh& mesh )
+{
+	FILE* pFile = fopen( filename, "r" );
+	if( pFile == NULL )
+		return E_FAIL;
+
+	std::vector< D3DXVECTOR2 > objTexCoords;
+	std::vector< bool > hasTexCoord;
+
+	mesh.positions.clear();
+	mesh.texCoords.clear();
+	mesh.indices.clear();
+
+	char line[ 1024 ];
+	while( fgets( line, sizeof( line ), pFile ) != NULL )
+	{
+		if( line[ 0 ] == 'v' && line[ 1 ] == ' ' )
+		{
+			D3DXVECTOR3 v( 0.0f, 0.0f, 0.0f );
+			sscanf( line + 2, "%f %f %f", &v.x, &v.y, &v.z );
+			mesh.positions.push_back( v );
+			mesh.texCoords.push_back( D3DXVECTOR2( 0.0f, 0.0f ) );
+			hasTexCoord.push_back( false );
+		}
+		else if( line[ 0 ] == 'v' && line[ 1 ] == 't' && line[ 2 ] == ' ' )
+		{
+			D3DXVECTOR2 t( 0.0f, 0.0f );
+			sscanf( line + 3, "%f %f", &t.x, &t.y );
+			t.y = 1.0f - t.y;	//.obj has v going up the image
+			objTexCoords.push_back( t );
+		}
+		else if( line[ 0 ] == 'f' && line[ 1 ] == ' ' )
+		{
+			//read the polygon's corners
+			int corners[ 64 ];
+			int numCorners = 0;
+
+			for( char* pToken = strtok( line + 2, " \t\r\n" );
+				 pToken != NULL && numCorners < 64;
+				 pToken = strtok( NULL, " \t\r\n" ) )
+			{
+				int position = 0, texCoord = 0;
+				if( sscanf( pToken, "%d/%d", &position, &texCoord ) < 1 )
+					continue;
+
+				position = ParseObjIndex( position, int( mesh.positions.size() ) );
+				if( position < 0 || position >= int( mesh.positions.size() ) )
+				{
+					fclose( pFile );
+					return E_FAIL;
+				}
+
+				//the first texture coordinate seen for a particle wins
+				if( texCoord != 0 && !hasTexCoord[ position ] )
+				{
+					texCoord = ParseObjIndex( texCoord, int( objTexCoords.size() ) );
+					if( texCoord >= 0 && texCoord < int( objTexCoords.size() ) )
+					{
+						mesh.texCoords[ position ]	= objTexCoords[ texCoord ];
+						hasTexCoord[ position ]		= true;
+					}
+				}
+
+				corners[ numCorners++ ] = position;
+			}
+
+			//triangulate as a fan, leaving out degenerate triangles
+			for( int corner = 2; corner < numCorners; ++corner )
+			{
+				if( corners[ 0 ] == corners[ corner - 1 ] ||
+					corners[ corner - 1 ] == corners[ corner ] ||
+					corners[ corner ] == corners[ 0 ] )
+					continue;
+
+				mesh.indices.push_back( corners[ 0 ] );
+				mesh.indices.push_back( corners[ corner - 1 ] );
+				mesh.indices.push_back( corners[ corner ] );
+			}
+		}
+	}
+
+	fclose( pFile );
+
+	if( mesh.positions.empty() || mesh.indices.empty() )
+		return E_FAIL;
+
+	//close up the positions no triangle uses, keeping the rest in order
+	std::vector< int > newIndex( mesh.positions.size(), -1 );
+	for( size_t i = 0; i < mesh.indices.size(); ++i )
+		newIndex[ mesh.indices[ i ] ] = 0;
+
+	int numUsed = 0;
+	for( size_t i = 0; i < mesh.positions.size(); ++i )
+	{
+		if( newIndex[ i ] < 0 )
+			continue;
+
+		newIndex[ i ]				= numUsed;
+		mesh.positions[ numUsed ]	= mesh.positions[ i ];
+		mesh.texCoords[ numUsed ]	= mesh.texCoords[ i ];
+		++numUsed;
+	}
+	mesh.positions.resize( numUsed );
+	mesh.texCoords.resize( numUsed );
+
+	for( size_t i = 0; i < mesh.indices.size(); ++i )
+		mesh.indices[ i ] = newIndex[ mesh.indices[ i ] ];
+
+	//with no texture coordinates, project the texture down from above
+	if( objTexCoords.empty() )
+	{
+		D3DXVECTOR3 vMin = mesh.positions[ 0 ];
+		D3DXVECTOR3 vMax = mesh.positions[ 0 ];
+		for( size_t i = 1; i < mesh.positions.size(); ++i )
+		{
+			D3DXVec3Minimize( &vMin, &vMin, &mesh.positions[ i ] );
+			D3DXVec3Maximize( &vMax, &vMax, &mesh.positions[ i ] );
+		}
+
+		const float sizeX = ( vMax.x > vMin.x ) ? vMax.x - vMin.x : 1.0f;
+		const float sizeZ = ( vMax.z > vMin.z ) ? vMax.z - vMin.z : 1.0f;
+		for( size_t i = 0; i < mesh.positions.size(); ++i )
+		{
+			mesh.texCoords[ i ].x = ( mesh.positions[ i ].x - vMin.x ) / sizeX;
+			mesh.texCoords[ i ].y = ( mesh.positions[ i ].z - vMin.z ) / sizeZ;
+		}
+	}
+
+	return S_OK;
+}
+
+//------------------------------------------------------------------------------
+// Name: ReorderClothMesh()
+// Desc: Sorts particles along a Morton curve through their rest positions so
+//		 that particles close in space are close in memory, then sorts the
+//		 triangles to walk the particles in the same order
+//------------------------------------------------------------------------------
+void ReorderClothMesh( ClothMesh& mesh )
+{
+	const int numParticles = int( mesh.positions.size() );
+	const int numTriangles = int( mesh.indices.size() / 3 );
+	if( numParticles == 0 )
+		return;
+
+	//find the bounds of the cloth
+	D3DXVECTOR3 vMin = mesh.positions[ 0 ];
+	D3DXVECTOR3 vMax = mesh.positions[ 0 ];
+	for( int i = 1; i < numParticles; ++i )
+	{
+		D3DXVec3Minimize( &vMin, &vMin, &mesh.positions[ i ] );
+		D3DXVec3Maximize( &vMax, &vMax, &mesh.positions[ i ] );
+	}
+
+	D3DXVECTOR3 vScale = vMax - vMin;
+	vScale.x = ( vScale.x > 0.0f ) ? 1023.0f / vScale.x : 0.0f;
+	vScale.y = ( vScale.y > 0.0f ) ? 1023.0f / vScale.y : 0.0f;
+	vScale.z = ( vScale.z > 0.0f ) ? 1023.0f / vScale.z : 0.0f;
+
+	//sort the particles by their morton codes
+	std::vector< SortKey > particleKeys( numParticles );
+	for( int i = 0; i < numParticles; ++i )
+	{
+		const D3DXVECTOR3 v = mesh.positions[ i ] - vMin;
+		particleKeys[ i ].key	= ( SpreadBits( DWORD( v.x * vScale.x ) ) << 0 ) |
+								  ( SpreadBits( DWORD( v.y * vScale.y ) ) << 1 ) |
+								  ( SpreadBits( DWORD( v.z * vScale.z ) ) << 2 );
+		particleKeys[ i ].index	= i;
+	}
+	std::sort( particleKeys.begin(), particleKeys.end() );
+
+	//move the particles to their new slots
+	std::vector< int > newIndex( numParticles );
+	std::vector< D3DXVECTOR3 > positions( numParticles );
+	std::vector< D3DXVECTOR2 > texCoords( numParticles );
+	for( int i = 0; i < numParticles; ++i )
+	{
+		const int oldIndex		= particleKeys[ i ].index;
+		newIndex[ oldIndex ]	= i;
+		positions[ i ]			= mesh.positions[ oldIndex ];
+		texCoords[ i ]			= mesh.texCoords[ oldIndex ];
+	}
+	mesh.positions.swap( positions );
+	mesh.texCoords.swap( texCoords );
+
+	//renumber the triangles and sort them by their lowest particle
+	std::vector< SortKey > triangleKeys( numTriangles );
+	for( int t = 0; t < numTriangles; ++t )
+	{
+		int* pTriangle = &mesh.indices[ t * 3 ];
+		pTriangle[ 0 ] = newIndex[ pTriangle[ 0 ] ];
+		pTriangle[ 1 ] = newIndex[ pTriangle[ 1 ] ];
+		pTriangle[ 2 ] = newIndex[ pTriangle[ 2 ] ];
+
+		triangleKeys[ t ].key	= DWORD( std::min( pTriangle[ 0 ],
+											   std::min( pTriangle[ 1 ], pTriangle[ 2 ] ) ) );
+		triangleKeys[ t ].index	= t;
+	}
+	std::sort( triangleKeys.begin(), triangleKeys.end() );
+
+	std::vector< int > indices( numTriangles * 3 );
+	for( int t = 0; t < numTriangles; ++t )
+	{
+		const int* pTriangle = &mesh.indices[ triangleKeys[ t ].index * 3 ];
+		indices[ t * 3 + 0 ] = pTriangle[ 0 ];
+		indices[ t * 3 + 1 ] = pTriangle[ 1 ];
+		indices[ t * 3 + 2 ] = pTriangle[ 2 ];
+	}
+	mesh.indices.swap( indices );
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildMeshConstraints()
+// Desc: Every edge becomes a distance constraint - shear if it is the longest
+//		 side of both its triangles (the diagonal of a quad), structural if not.
+//		 Each pair of triangles sharing an edge adds a bending constraint
+//		 between the two particles opposite the shared edge.
+//------------------------------------------------------------------------------
+void BuildMeshConstraints( const ClothMesh& mesh,
+						   std::vector< ClothConstraint >& constraints )
+{
+	const int numTriangles = int( mesh.indices.size() / 3 );
+
+	//collect the sides of every triangle
+	std::vector< MeshEdge > edges;
+	edges.reserve( numTriangles * 3 );
+
+	for( int t = 0; t < numTriangles; ++t )
+	{
+		const int* pTriangle = &mesh.indices[ t * 3 ];
+
+		//skip degenerate triangles
+		if( pTriangle[ 0 ] == pTriangle[ 1 ] || pTriangle[ 1 ] == pTriangle[ 2 ] ||
+			pTriangle[ 2 ] == pTriangle[ 0 ] )
+			continue;
+
+		float lengthSq[ 3 ];
+		for( int side = 0; side < 3; ++side )
+		{
+			D3DXVECTOR3 vDelta = mesh.positions[ pTriangle[ ( side + 1 ) % 3 ] ] -
+								 mesh.positions[ pTriangle[ side ] ];
+			lengthSq[ side ] = D3DXVec3LengthSq( &vDelta );
+		}
+
+		for( int side = 0; side < 3; ++side )
+		{
+			const int particleA = pTriangle[ side ];
+			const int particleB = pTriangle[ ( side + 1 ) % 3 ];
+
+			MeshEdge e;
+			e.a			= ( particleA < particleB ) ? particleA : particleB;
+			e.b			= ( particleA < particleB ) ? particleB : particleA;
+			e.opposite	= pTriangle[ ( side + 2 ) % 3 ];
+			e.longest	= lengthSq[ side ] >= lengthSq[ ( side + 1 ) % 3 ] &&
+						  lengthSq[ side ] >= lengthSq[ ( side + 2 ) % 3 ];
+			edges.push_back( e );
+		}
+	}
+	std::sort( edges.begin(), edges.end() );
+
+	//walk the runs of matching sides
+	constraints.clear();
+	constraints.reserve( edges.size() );
+
+	for( size_t first = 0; first < edges.size(); )
+	{
+		size_t last = first + 1;
+		while( last < edges.size() && edges[ last ].a == edges[ first ].a &&
+			   edges[ last ].b == edges[ first ].b )
+			++last;
+
+		//an interior edge between exactly two triangles may be a quad diagonal
+		const bool isShear = ( last - first == 2 ) && edges[ first ].longest &&
+							 edges[ first + 1 ].longest;
+		constraints.push_back( MakeConstraint( mesh, edges[ first ].a, edges[ first ].b,
+											   isShear ? CONSTRAINT_SHEAR
+													   : CONSTRAINT_STRUCTURAL ) );
+
+		//bend across each pair of triangles sharing this edge
+		for( size_t i = first; i + 1 < last; i += 2 )
+		{
+			if( edges[ i ].opposite != edges[ i + 1 ].opposite )
+				constraints.push_back( MakeConstraint( mesh, edges[ i ].opposite,
+													   edges[ i + 1 ].opposite,
+													   CONSTRAINT_BEND ) );
+		}
+
+		first = last;
+	}
+
+	//drop duplicates, keeping the stiffest type
+	std::sort( constraints.begin(), constraints.end(), ConstraintLess );
+	constraints.erase( std::unique( constraints.begin(), constraints.end(), SameParticles ),
+					   constraints.end() );
+}
+
+//------------------------------------------------------------------------------
+// Name: BatchConstraints()
+// Desc: Sorts the constraints by particle and greedily colours them so that no
+//		 two constraints in a batch touch the same particle. Each batch then
+//		 sweeps through memory in order, and can be solved in any order.
+//------------------------------------------------------------------------------
+void BatchConstraints( std::vector< ClothConstraint >& constraints,
+					   std::vector< ConstraintBatch >& batches )
+{
+	const int numConstraints = int( constraints.size() );
+	std::sort( constraints.begin(), constraints.end(), ConstraintLess );
+
+	batches.clear();
+	if( numConstraints == 0 )
+		return;
+
+	int numParticles = 0;
+	for( int i = 0; i < numConstraints; ++i )
+		numParticles = std::max( numParticles, constraints[ i ].particleB + 1 );
+
+	//colour 32 batches at a time, carrying anything left over to the next pass
+	std::vector< SortKey > colours( numConstraints );
+	std::vector< DWORD > used( numParticles );
+	int numColoured = 0;
+
+	for( DWORD firstColour = 0; numColoured < numConstraints; firstColour += 32 )
+	{
+		std::fill( used.begin(), used.end(), 0 );
+
+		for( int i = 0; i < numConstraints; ++i )
+		{
+			if( firstColour != 0 && colours[ i ].key < firstColour )
+				continue;
+
+			const ClothConstraint& c = constraints[ i ];
+			const DWORD freeColours = ~( used[ c.particleA ] | used[ c.particleB ] );
+			if( freeColours == 0 )
+			{
+				colours[ i ].key = firstColour + 32;
+				continue;
+			}
+
+			//take the lowest free colour
+			DWORD colour = 0;
+			while( ( freeColours & ( DWORD( 1 ) << colour ) ) == 0 )
+				++colour;
+
+			used[ c.particleA ] |= DWORD( 1 ) << colour;
+			used[ c.particleB ] |= DWORD( 1 ) << colour;
+			colours[ i ].key	= firstColour + colour;
+			colours[ i ].index	= i;
+			++numColoured;
+		}
+	}
+
+	//gather each colour together, keeping the particle order within it
+	std::sort( colours.begin(), colours.end() );
+
+	std::vector< ClothConstraint > sorted( numConstraints );
+	for( int i = 0; i < numConstraints; ++i )
+		sorted[ i ] = constraints[ colours[ i ].index ];
+	constraints.swap( sorted );
+
+	for( int i = 0; i < numConstraints; ++i )
+	{
+		if( i == 0 || colours[ i ].key != colours[ i - 1 ].key )
+		{
+			ConstraintBatch batch;
+			batch.first = i;
+			batch.count = 0;
+			batches.push_back( batch );
+		}
+		++batches.back().count;
+	}
+}
@@ -0,0 +1,54 @@
+//------------------------------------------------------------------------------
+// File: ClothMesh.h
+// Desc: Arbitrary triangle mesh cloth topology and constraint generation
+//
+// Created: 18 October 2026 15:30:59
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_CLOTHMESH_H
+#define INCLUSIONGUARD_CLOTHMESH_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <vector>
+#include <d3dx9.h>
+#include "ParticleSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: struct ClothMesh
+// Desc: The rest shape of a cloth - one particle per position
+//------------------------------------------------------------------------------
+struct ClothMesh
+{
+	std::vector< D3DXVECTOR3 >	positions;	//rest positions
+	std::vector< D3DXVECTOR2 >	texCoords;	//one per position
+	std::vector< int >			indices;	//three per triangle
+};
+
+//loads a triangle mesh from a wavefront .obj file, welding seams by position index
+HRESULT LoadClothMesh( const char* filename, ClothMesh& mesh );
+
+//reorders particles along a space-filling curve and triangles to follow them
+void ReorderClothMesh( ClothMesh& mesh );
+
+//builds structural and shear constraints from the edges and bending
+//constraints across each pair of adjacent triangles
+void BuildMeshConstraints( const ClothMesh& mesh,
+						   std::vector< ClothConstraint >& constraints );
+
+//sorts constraints by particle and groups them into independent batches
+void BatchConstraints( std::vector< ClothConstraint >& constraints,
+					   std::vector< ConstraintBatch >& batches );
+
+
+#endif //INCLUSIONGUARD_CLOTHMESH_H
@@ -0,0 +1,591 @@
+//------------------------------------------------------------------------------
+// File: ClothServer.cpp
+// Desc: Publishes the cloth's frames through shared memory to other
+//		 processes, and takes their commands back
+//
+// Created: 18 October 2026 16:54:32
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include "ClothServer.h"
+#include <mmsystem.h>
+#include "ClothMesh.h"
+#include "ClothTuner.h"
+#include "JobSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//slots and the arrays in them start on their own cache lines, so a reader
+//spinning on one slot's sequence does not slow the writer of the next
+static const DWORD SHARED_ALIGNMENT = 64;
+
+static DWORD AlignShared( const DWORD offset )
+{
+	return ( offset + SHARED_ALIGNMENT - 1 ) & ~( SHARED_ALIGNMENT - 1 );
+}
+
+//------------------------------------------------------------------------------
+// Name: ClothServer()
+// Desc: Constructor for a server with no shared block yet
+//------------------------------------------------------------------------------
+ClothServer::ClothServer()
+{
+	m_hMapping			= NULL;
+	m_pHeader			= NULL;
+	m_pTopology			= NULL;
+	m_pTriangles		= NULL;
+	m_pWriting			= NULL;
+	m_writingSlot		= 0;
+	m_numFrames			= 0;
+	m_topologyRevision	= 0;
+	m_topologyStale		= true;
+	m_topologyTears		= 0;
+}
+
+//------------------------------------------------------------------------------
+// Name: ~ClothServer()
+// Desc: Destructor for the server - unmaps the shared block
+//------------------------------------------------------------------------------
+ClothServer::~ClothServer()
+{
+	Release();
+}
+
+//------------------------------------------------------------------------------
+// Name: Create()
+// Desc: Creates the named shared block with room for the given cloth, and
+//		 lays it out. Fails if another server already has the name.
+//------------------------------------------------------------------------------
+HRESULT ClothServer::Create( const char* name, const int maxParticles,
+							 const int maxTriangles )
+{
+	Release();
+
+	const DWORD topologyOffset	= AlignShared( sizeof( SharedClothHeader ) );
+	const DWORD vertexOffset	= AlignShared( sizeof( SharedClothFrame ) );
+	const DWORD slotBytes		= AlignShared( vertexOffset + ( maxParticles * sizeof( CLOTH_VERTEX ) ) );
+	const DWORD slotOffset		= AlignShared( topologyOffset + sizeof( SharedClothTopology ) +
+											   ( maxTriangles * 3 * sizeof( int ) ) );
+	const DWORD blockBytes		= slotOffset + ( NUM_SLOTS * slotBytes );
+
+	m_hMapping = CreateFileMapping( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+									blockBytes, name );
+	if( m_hMapping == NULL )
+		return E_FAIL;
+
+	if( GetLastError() == ERROR_ALREADY_EXISTS )
+	{
+		Release();
+		return E_FAIL;
+	}
+
+	BYTE* const pBase = (BYTE*)MapViewOfFile( m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0 );
+	if( pBase == NULL )
+	{
+		Release();
+		return E_FAIL;
+	}
+
+	//the pages come zeroed, so only the non-zero fields need setting
+	m_pHeader		= (SharedClothHeader*)pBase;
+	m_pTopology		= (SharedClothTopology*)( pBase + topologyOffset );
+	m_pTriangles	= (int*)( m_pTopology + 1 );
+
+	SharedClothHeader& header = *m_pHeader;
+	header.version			= CLOTH_SERVER_VERSION;
+	header.blockBytes		= blockBytes;
+	header.maxParticles		= maxParticles;
+	header.maxTriangles		= maxTriangles;
+	header.numSlots			= NUM_SLOTS;
+	header.topologyOffset	= topologyOffset;
+	header.slotOffset		= slotOffset;
+	header.slotBytes		= slotBytes;
+	header.vertexOffset		= vertexOffset;
+	header.latestSlot		= -1;
+
+	for( int cell = 0; cell < SharedClothHeader::MAX_COMMANDS; ++cell )
+		header.commands[ cell ].sequence = cell;
+
+	//clients check the magic number last, once the rest is in place
+	InterlockedExchange( (volatile LONG*)&header.magic, LONG( CLOTH_SERVER_MAGIC ) );
+
+	m_writingSlot		= 0;
+	m_numFrames			= 0;
+	m_topologyRevision	= 0;
+	m_topologyStale		= true;
+
+	return S_OK;
+}
+
+//------------------------------------------------------------------------------
+// Name: Release()
+// Desc: Unmaps the shared block. Clients keep their own views of it.
+//------------------------------------------------------------------------------
+void ClothServer::Release()
+{
+	if( m_pHeader != NULL )
+		UnmapViewOfFile( m_pHeader );
+	if( m_hMapping != NULL )
+		CloseHandle( m_hMapping );
+
+	m_hMapping		= NULL;
+	m_pHeader		= NULL;
+	m_pTopology		= NULL;
+	m_pTriangles	= NULL;
+	m_pWriting		= NULL;
+}
+
+//------------------------------------------------------------------------------
+// Name: BeginFrame()
+// Desc: Marks the slot after the newest frame as being written and returns
+//		 its vertices. The newest frame is left alone, and any reader still
+//		 on this slot will see the sequence change.
+//------------------------------------------------------------------------------
+CLOTH_VERTEX* ClothServer::BeginFrame()
+{
+	const SharedClothHeader& header = *m_pHeader;
+
+	m_writingSlot	= ( header.latestSlot + 1 ) % header.numSlots;
+	m_pWriting		= (SharedClothFrame*)( (BYTE*)m_pHeader + header.slotOffset +
+										   ( m_writingSlot * header.slotBytes ) );
+
+	//odd until EndFrame(); the interlocked increment orders it before the writes
+	InterlockedIncrement( &m_pWriting->sequence );
+
+	return (CLOTH_VERTEX*)( (BYTE*)m_pWriting + header.vertexOffset );
+}
+
+//------------------------------------------------------------------------------
+// Name: EndFrame()
+// Desc: Finishes the slot the cloth's step has written its vertices to and
+//		 makes it the newest frame, republishing the triangles first if they
+//		 have changed
+//------------------------------------------------------------------------------
+void ClothServer::EndFrame( const ParticleSystem& cloth )
+{
+	if( m_topologyStale || cloth.GetNumTears() != m_topologyTears )
+		PublishTopology( cloth );
+
+	SharedClothFrame& frame = *m_pWriting;
+	frame.frame				= m_numFrames++;
+	frame.topologyRevision	= m_topologyRevision;
+	frame.numParticles		= cloth.GetNumParticles();
+	frame.spherePosition	= cloth.GetSpherePosition();
+	frame.sphereRadius		= cloth.GetSphereRadius();
+	frame.timeStep			= cloth.GetTimeStep();
+	frame.checksum			= cloth.IsDeterministic() ? cloth.GetChecksum() : 0;
+	frame.residual			= cloth.IsSpecialised() ? 0.0f : cloth.GetSolverStats().lastResidual;
+
+	InterlockedIncrement( &frame.sequence );
+	InterlockedExchange( &m_pHeader->latestSlot, m_writingSlot );
+	m_pWriting = NULL;
+}
+
+//------------------------------------------------------------------------------
+// Name: PublishTopology()
+// Desc: Copies the cloth's triangles into the shared block under a new
+//		 revision. Tearing re-points the corners of existing triangles, so
+//		 the count never outgrows the block.
+//------------------------------------------------------------------------------
+void ClothServer::PublishTopology( const ParticleSystem& cloth )
+{
+	SharedClothTopology& topology = *m_pTopology;
+	const int numTriangles = std::min( cloth.GetNumTriangles(), m_pHeader->maxTriangles );
+
+	InterlockedIncrement( &topology.sequence );
+
+	memcpy( m_pTriangles, cloth.GetTriangles(), numTriangles * 3 * sizeof( int ) );
+	topology.numTriangles	= numTriangles;
+	topology.revision		= ++m_topologyRevision;
+
+	InterlockedIncrement( &topology.sequence );
+
+	m_topologyStale = false;
+	m_topologyTears	= cloth.GetNumTears();
+}
+
+//------------------------------------------------------------------------------
+// Name: PopCommand()
+// Desc: Takes the command at the tail of the queue if a client has finished
+//		 writing it, and hands its cell back for a later lap of the queue
+//------------------------------------------------------------------------------
+bool ClothServer::PopCommand( ClothCommand& command )
+{
+	SharedClothHeader& header = *m_pHeader;
+	const LONG position = header.commandTail;
+	SharedClothCommand& cell = header.commands[ position & ( SharedClothHeader::MAX_COMMANDS - 1 ) ];
+
+	if( cell.sequence != position + 1 )
+		return false;
+
+	MemoryBarrier();
+	command = cell.command;
+
+	InterlockedExchange( &cell.sequence, position + SharedClothHeader::MAX_COMMANDS );
+	header.commandTail = position + 1;
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: ClothClient()
+// Desc: Constructor for a client not yet attached to a server
+//------------------------------------------------------------------------------
+ClothClient::ClothClient()
+{
+	m_hMapping	= NULL;
+	m_pHeader	= NULL;
+}
+
+//------------------------------------------------------------------------------
+// Name: ~ClothClient()
+// Desc: Destructor for the client - unmaps the shared block
+//------------------------------------------------------------------------------
+ClothClient::~ClothClient()
+{
+	Close();
+}
+
+//------------------------------------------------------------------------------
+// Name: Open()
+// Desc: Maps a running server's shared block
+//------------------------------------------------------------------------------
+HRESULT ClothClient::Open( const char* name )
+{
+	Close();
+
+	m_hMapping = OpenFileMapping( FILE_MAP_ALL_ACCESS, FALSE, name );
+	if( m_hMapping == NULL )
+		return E_FAIL;
+
+	m_pHeader = (SharedClothHeader*)MapViewOfFile( m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0 );
+	if( m_pHeader == NULL )
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	//a server still laying the block out has not set the magic number yet
+	MemoryBarrier();
+	if( m_pHeader->magic != CLOTH_SERVER_MAGIC || m_pHeader->version != CLOTH_SERVER_VERSION )
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
+//------------------------------------------------------------------------------
+// Name: Close()
+// Desc: Unmaps the shared block
+//------------------------------------------------------------------------------
+void ClothClient::Close()
+{
+	if( m_pHeader != NULL )
+		UnmapViewOfFile( m_pHeader );
+	if( m_hMapping != NULL )
+		CloseHandle( m_hMapping );
+
+	m_hMapping	= NULL;
+	m_pHeader	= NULL;
+}
+
+//------------------------------------------------------------------------------
+// Name: BeginRead()
+// Desc: Returns the newest frame and the sequence to hand to EndRead()
+//------------------------------------------------------------------------------
+const SharedClothFrame* ClothClient::BeginRead( LONG& sequence ) const
+{
+	const LONG slot = m_pHeader->latestSlot;
+	if( slot < 0 )
+		return NULL;
+
+	const SharedClothFrame* pFrame = (const SharedClothFrame*)
+		( (const BYTE*)m_pHeader + m_pHeader->slotOffset + ( slot * m_pHeader->slotBytes ) );
+
+	sequence = pFrame->sequence;
+	MemoryBarrier();
+
+	//lapped by the server between the two reads
+	if( sequence & 1 )
+		return NULL;
+
+	return pFrame;
+}
+
+//------------------------------------------------------------------------------
+// Name: EndRead()
+// Desc: Returns true if the frame was not rewritten while it was read.
+//		 Anything taken from it otherwise must be thrown away.
+//------------------------------------------------------------------------------
+bool ClothClient::EndRead( const SharedClothFrame* pFrame, const LONG sequence ) const
+{
+	MemoryBarrier();
+	return pFrame->sequence == sequence;
+}
+
+//------------------------------------------------------------------------------
+// Name: GetVertices()
+// Desc: The frame's vertices, in place in the shared block
+//------------------------------------------------------------------------------
+const CLOTH_VERTEX* ClothClient::GetVertices( const SharedClothFrame* pFrame ) const
+{
+	return (const CLOTH_VERTEX*)( (const BYTE*)pFrame + m_pHeader->vertexOffset );
+}
+
+//------------------------------------------------------------------------------
+// Name: BeginReadTopology()
+// Desc: Returns the triangles' header and the sequence to hand to
+//		 EndReadTopology(), or NULL while the server is rewriting them
+//------------------------------------------------------------------------------
+const SharedClothTopology* ClothClient::BeginReadTopology( LONG& sequence ) const
+{
+	const SharedClothTopology* pTopology = (const SharedClothTopology*)
+		( (const BYTE*)m_pHeader + m_pHeader->topologyOffset );
+
+	sequence = pTopology->sequence;
+	MemoryBarrier();
+
+	//still zero before the server's first frame
+	if( ( sequence & 1 ) || sequence == 0 )
+		return NULL;
+
+	return pTopology;
+}
+
+//------------------------------------------------------------------------------
+// Name: EndReadTopology()
+// Desc: Returns true if the triangles were not rewritten while they were read
+//------------------------------------------------------------------------------
+bool ClothClient::EndReadTopology( const LONG sequence ) const
+{
+	const SharedClothTopology* pTopology = (const SharedClothTopology*)
+		( (const BYTE*)m_pHeader + m_pHeader->topologyOffset );
+
+	MemoryBarrier();
+	return pTopology->sequence == sequence;
+}
+
+//------------------------------------------------------------------------------
+// Name: GetTriangles()
+// Desc: The triangles, in place in the shared block
+//------------------------------------------------------------------------------
+const int* ClothClient::GetTriangles() const
+{
+	return (const int*)( (const BYTE*)m_pHeader + m_pHeader->topologyOffset +
+						 sizeof( SharedClothTopology ) );
+}
+
+//------------------------------------------------------------------------------
+// Name: PostCommand()
+// Desc: Claims the next queue position, against other clients doing the
+//		 same, and fills its cell. A cell the server has not taken a lap ago
+//		 means the queue is full.
+//------------------------------------------------------------------------------
+HRESULT ClothClient::PostCommand( const ClothCommand& command )
+{
+	SharedClothHeader& header = *m_pHeader;
+
+	LONG position = header.commandHead;
+	for( ;; )
+	{
+		SharedClothCommand& cell = header.commands[ position & ( SharedClothHeader::MAX_COMMANDS - 1 ) ];
+		const LONG lag = cell.sequence - position;
+
+		if( lag < 0 )
+			return E_FAIL;
+
+		if( lag == 0 )
+		{
+			const LONG claimed = InterlockedCompareExchange( &header.commandHead, position + 1,
+															 position );
+			if( claimed == position )
+			{
+				cell.command = command;
+				InterlockedExchange( &cell.sequence, position + 1 );
+				return S_OK;
+			}
+			position = claimed;
+		}
+		else
+		{
+			//another client claimed this position first
+			position = header.commandHead;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: ApplyCommand()
+// Desc: Carries out a client's command between steps, returning false for
+//		 COMMAND_QUIT
+//------------------------------------------------------------------------------
+static bool ApplyCommand( const ClothCommand& command, ParticleSystem& cloth,
+						  ClothServer& server )
+{
+	switch( command.type )
+	{
+	case COMMAND_RESET:
+		cloth.Initialise();
+		server.InvalidateTopology();
+		break;
+
+	case COMMAND_TIME_STEP:
+		if( command.params[ 0 ] > 0.0f )
+			cloth.SetTimeStep( command.params[ 0 ] );
+		break;
+
+	case COMMAND_ITERATIONS:
+		if( command.value > 0 )
+			cloth.SetNumIterations( command.value );
+		break;
+
+	case COMMAND_SUBSTEPS:
+		if( command.value > 0 )
+			cloth.SetNumSubsteps( command.value );
+		break;
+
+	case COMMAND_SOLVER:
+		cloth.SetSolver( command.value == SOLVER_XPBD ? SOLVER_XPBD : SOLVER_JAKOBSEN );
+		break;
+
+	case COMMAND_TEARING:
+		cloth.SetTearing( command.value != 0 );
+		break;
+
+	case COMMAND_SPHERE:
+		cloth.SetSphere( D3DXVECTOR3( command.params[ 0 ], command.params[ 1 ],
+									  command.params[ 2 ] ),
+						 std::max( command.params[ 3 ], 0.0f ) );
+		break;
+
+	case COMMAND_DETERMINISTIC:
+		cloth.SetDeterministic( command.value != 0 );
+		break;
+
+	case COMMAND_OVER_RELAX:
+		if( command.params[ 0 ] > 0.0f && command.params[ 0 ] < 2.0f )
+			cloth.SetOverRelaxation( command.params[ 0 ] );
+		break;
+
+	case COMMAND_CHEBYSHEV:
+		cloth.SetChebyshev( command.value != 0 );
+		break;
+
+	case COMMAND_QUIT:
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Name: RunClothServer()
+// Desc: Steps the cloth in real time on the worker threads, straight into
+//		 the shared frame ring, taking commands between steps. Falling
+//		 behind drops the lost time rather than trying to catch up.
+//------------------------------------------------------------------------------
+int RunClothServer( const char* name, const char* clothMeshFile )
+{
+	JobSystem* pJobs = NULL;
+	ParticleSystem* pCloth = NULL;
+	ClothServer server;
+
+	try
+	{
+		//with no window to say so, a mesh that will not load ends the server
+		ClothMesh mesh;
+		const bool useMesh = clothMeshFile != NULL && clothMeshFile[ 0 ] != '\0';
+		if( useMesh && FAILED( LoadClothMesh( clothMeshFile, mesh ) ) )
+			return 1;
+
+		ClothTuning tuning;
+		TuneCloth( ParticleSystem::DEFAULT_PRTS_PER_DIM, useMesh ? &mesh : NULL, tuning );
+
+		pJobs = new JobSystem( tuning.numThreads );
+
+		if( useMesh )
+			pCloth = new ParticleSystem( mesh, pJobs, tuning.storage );
+		else
+			pCloth = new ParticleSystem( ParticleSystem::DEFAULT_PRTS_PER_DIM, pJobs,
+										 tuning.storage );
+
+		pCloth->SetTileDim( tuning.tileDim );
+		pCloth->SetSpecialisation( tuning.specialisation );
+	}
+	catch( std::bad_alloc& )
+	{
+		delete pJobs;
+		return 1;
+	}
+
+	if( FAILED( server.Create( name, pCloth->GetMaxParticles(), pCloth->GetNumTriangles() ) ) )
+	{
+		delete pCloth;
+		delete pJobs;
+		return 1;
+	}
+
+	//Sleep() is only as fine as the system timer, 10 to 15 ms unless asked
+	TIMECAPS caps;
+	const UINT timerPeriod = ( timeGetDevCaps( &caps, sizeof( caps ) ) == TIMERR_NOERROR ) ?
+							 std::max( caps.wPeriodMin, UINT( 1 ) ) : 1;
+	timeBeginPeriod( timerPeriod );
+
+	LARGE_INTEGER frequency, now, nextStep;
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &nextStep );
+
+	bool running = true;
+	while( running )
+	{
+		ClothCommand command;
+		while( running && server.PopCommand( command ) )
+			running = ApplyCommand( command, *pCloth, server );
+
+		if( !running )
+			break;
+
+		pCloth->BeginTimeStep( *pJobs, server.BeginFrame() );
+		pCloth->EndTimeStep( *pJobs );
+		server.EndFrame( *pCloth );
+
+		//wait out the rest of the step, sleeping while more than a timer
+		//period of it is left and spinning through the last of it, as a
+		//sleep can overrun by up to a period
+		nextStep.QuadPart += LONGLONG( pCloth->GetTimeStep() * frequency.QuadPart );
+		QueryPerformanceCounter( &now );
+		if( now.QuadPart > nextStep.QuadPart )
+			nextStep = now;
+		else
+		{
+			const LONGLONG remainingMs = ( ( nextStep.QuadPart - now.QuadPart ) * 1000 ) /
+										 frequency.QuadPart;
+			if( remainingMs > LONGLONG( timerPeriod ) )
+				Sleep( DWORD( remainingMs - timerPeriod ) );
+
+			do
+				QueryPerformanceCounter( &now );
+			while( now.QuadPart < nextStep.QuadPart );
+		}
+	}
+
+	timeEndPeriod( timerPeriod );
+	server.Release();
+	delete pCloth;
+	delete pJobs;
+	return 0;
+}
@@ -0,0 +1,224 @@
+//------------------------------------------------------------------------------
+// File: ClothServer.h
+// Desc: Publishes the cloth's frames through shared memory to other
+//		 processes, and takes their commands back
+//
+// Created: 18 October 2026 16:54:32
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_CLOTHSERVER_H
+#define INCLUSIONGUARD_CLOTHSERVER_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <windows.h>
+#include <d3dx9.h>
+#include "ParticleSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+
+//the mapping a server creates unless it is given another name
+#define DEFAULT_CLOTH_SERVER_NAME "Local\\ClothServer"
+
+const DWORD CLOTH_SERVER_MAGIC		= 0x48544c43;	//"CLTH"
+const DWORD CLOTH_SERVER_VERSION	= 3;
+
+//------------------------------------------------------------------------------
+// Name: enum ClothCommandType
+// Desc: What a client can ask the server to change between steps
+//------------------------------------------------------------------------------
+enum ClothCommandType
+{
+	COMMAND_RESET = 0,		//back to the rest state
+	COMMAND_TIME_STEP,		//params[ 0 ] is the time step
+	COMMAND_ITERATIONS,		//value is the relaxation iterations
+	COMMAND_SUBSTEPS,		//value is the substeps
+	COMMAND_SOLVER,			//value is a ConstraintSolver
+	COMMAND_TEARING,		//value turns tearing on or off
+	COMMAND_SPHERE,			//params are the collider's position and radius
+	COMMAND_DETERMINISTIC,	//value turns deterministic stepping on or off
+	COMMAND_OVER_RELAX,		//params[ 0 ] is the projection over-relaxation factor
+	COMMAND_CHEBYSHEV,		//value turns Chebyshev extrapolation on or off
+	COMMAND_QUIT			//stops the server
+};
+
+//------------------------------------------------------------------------------
+// Name: struct ClothCommand
+// Desc: One command for the server
+//------------------------------------------------------------------------------
+struct ClothCommand
+{
+	int		type;
+	int		value;
+	float	params[ 4 ];
+};
+
+//------------------------------------------------------------------------------
+// Name: struct SharedClothCommand
+// Desc: A cell of the command queue. Its sequence says whose turn it is: a
+//		 client may fill the cell for queue position n once the sequence is
+//		 n, and the server may take it once it is n + 1.
+//------------------------------------------------------------------------------
+struct SharedClothCommand
+{
+	volatile LONG	sequence;
+	ClothCommand	command;
+};
+
+//------------------------------------------------------------------------------
+// Name: struct SharedClothHeader
+// Desc: The start of the shared block. The topology and the ring of frame
+//		 slots follow it at the given offsets.
+//------------------------------------------------------------------------------
+struct SharedClothHeader
+{
+	const static int MAX_COMMANDS = 64;		//a power of two
+
+	DWORD	magic;
+	DWORD	version;
+	DWORD	blockBytes;
+	int		maxParticles;
+	int		maxTriangles;
+	int		numSlots;
+	DWORD	topologyOffset;
+	DWORD	slotOffset;
+	DWORD	slotBytes;
+	DWORD	vertexOffset;		//from the start of each slot
+
+	volatile LONG	latestSlot;		//newest whole frame, -1 before the first
+	volatile LONG	commandHead;	//next queue position a client will claim
+	LONG			commandTail;	//next queue position the server will take
+
+	SharedClothCommand commands[ MAX_COMMANDS ];
+};
+
+//------------------------------------------------------------------------------
+// Name: struct SharedClothTopology
+// Desc: The cloth's triangles, three particles each, rewritten when tearing
+//		 or a reset changes them. The sequence is odd while they are written.
+//------------------------------------------------------------------------------
+struct SharedClothTopology
+{
+	volatile LONG	sequence;
+	LONG			revision;
+	int				numTriangles;
+	//followed by int triangles[ maxTriangles * 3 ]
+};
+
+//------------------------------------------------------------------------------
+// Name: struct SharedClothFrame
+// Desc: One slot of the frame ring. The sequence is odd while the server
+//		 writes the slot; a reader that sees the same even sequence before
+//		 and after reading had a whole frame.
+//------------------------------------------------------------------------------
+struct SharedClothFrame
+{
+	volatile LONG	sequence;
+	LONG			frame;				//steps since the server started
+	LONG			topologyRevision;	//the triangles these vertices go with
+	int				numParticles;
+	D3DXVECTOR3		spherePosition;
+	float			sphereRadius;
+	float			timeStep;
+	DWORD			checksum;			//of the positions, when deterministic, else 0
+	float			residual;			//RMS error of the last sweep, 0 from a grid kernel
+	//followed by CLOTH_VERTEX vertices[ maxParticles ] at the header's vertexOffset
+};
+
+//------------------------------------------------------------------------------
+// Name: class ClothServer
+// Desc: The simulation's side of the shared block. Each step writes its
+//		 vertices straight into the next slot of the ring, so nothing is
+//		 copied, and no client is ever waited for: one too slow to finish
+//		 reading a slot before it comes round again just finds it changed.
+//------------------------------------------------------------------------------
+class ClothServer
+{
+public:
+	const static int NUM_SLOTS = 4;
+
+	ClothServer();
+	~ClothServer();
+
+	HRESULT Create( const char* name, const int maxParticles, const int maxTriangles );
+	void Release();
+
+	//the vertices for the next frame, for the step to write to, until EndFrame()
+	CLOTH_VERTEX* BeginFrame();
+	void EndFrame( const ParticleSystem& cloth );
+
+	//republishes the triangles at the end of the next frame, as after a reset
+	void InvalidateTopology() { m_topologyStale = true; }
+
+	//takes the oldest waiting command, returning false if there is none
+	bool PopCommand( ClothCommand& command );
+
+	LONG GetNumFrames() const { return m_numFrames; }
+
+private:
+	void PublishTopology( const ParticleSystem& cloth );
+
+	HANDLE					m_hMapping;
+	SharedClothHeader*		m_pHeader;
+	SharedClothTopology*	m_pTopology;
+	int*					m_pTriangles;
+	SharedClothFrame*		m_pWriting;		//slot between BeginFrame() and EndFrame()
+	LONG					m_writingSlot;
+
+	LONG	m_numFrames;
+	LONG	m_topologyRevision;
+	bool	m_topologyStale;
+	int		m_topologyTears;	//tears behind the published triangles
+};
+
+//------------------------------------------------------------------------------
+// Name: class ClothClient
+// Desc: A renderer's or tool's side of the shared block. Frames are read in
+//		 place: BeginRead() gives the newest frame and EndRead() says whether
+//		 it stayed whole while it was used.
+//------------------------------------------------------------------------------
+class ClothClient
+{
+public:
+	ClothClient();
+	~ClothClient();
+
+	HRESULT Open( const char* name = DEFAULT_CLOTH_SERVER_NAME );
+	void Close();
+
+	//the newest frame, or NULL if there is none yet or the server has just
+	//come round to rewriting it
+	const SharedClothFrame* BeginRead( LONG& sequence ) const;
+	bool EndRead( const SharedClothFrame* pFrame, const LONG sequence ) const;
+	const CLOTH_VERTEX* GetVertices( const SharedClothFrame* pFrame ) const;
+
+	//the same for the triangles
+	const SharedClothTopology* BeginReadTopology( LONG& sequence ) const;
+	bool EndReadTopology( const LONG sequence ) const;
+	const int* GetTriangles() const;
+
+	//queues a command, failing rather than waiting if the queue is full
+	HRESULT PostCommand( const ClothCommand& command );
+
+	const SharedClothHeader* GetHeader() const { return m_pHeader; }
+
+private:
+	HANDLE				m_hMapping;
+	SharedClothHeader*	m_pHeader;
+};
+
+//runs the cloth with no window, publishing every step under the given name
+//until a client sends COMMAND_QUIT. Returns the process exit code, which is
+//1 if the cloth mesh file, when there is one, cannot be loaded.
+int RunClothServer( const char* name, const char* clothMeshFile );
+
+
+#endif //INCLUSIONGUARD_CLOTHSERVER_H
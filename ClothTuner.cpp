@@ -0,0 +1,330 @@
+//------------------------------------------------------------------------------
+// File: ClothTuner.cpp
+// Desc: Picks the fastest way to step a cloth on this machine, once
+//
+// Created: 18 October 2026 17:03:06
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "ClothTuner.h"
+#include "ClothMesh.h"
+#include "JobSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//steps to settle the cloth onto the sphere, then steps timed in rounds, the
+//fastest round counting, so a stray interruption does not decide anything
+static const int TUNE_WARMUP_STEPS	= 40;
+static const int TUNE_ROUND_STEPS	= 20;
+static const int TUNE_ROUNDS		= 5;
+
+//bumped whenever a cached tuning would no longer mean the same thing
+static const int TUNE_CACHE_VERSION	= 1;
+
+static const int TUNE_TILE_DIMS[] = { 4, 8, 16 };
+static const IntegratorStorage TUNE_STORAGE[] = { STORE_FLOAT, STORE_HALF, STORE_QUANTISED };
+
+//------------------------------------------------------------------------------
+// Name: GetSeconds()
+// Desc: Reads the performance counter in seconds
+//------------------------------------------------------------------------------
+static double GetSeconds()
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter( &counter );
+	QueryPerformanceFrequency( &frequency );
+
+	return double( counter.QuadPart ) / double( frequency.QuadPart );
+}
+
+//------------------------------------------------------------------------------
+// Name: GetNumProcessors()
+// Desc: Returns how many processors the system has
+//------------------------------------------------------------------------------
+static int GetNumProcessors()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+
+	return std::max( int( info.dwNumberOfProcessors ), 1 );
+}
+
+//------------------------------------------------------------------------------
+// Name: GetDefaultTuning()
+// Desc: One worker for each processor after the first, as JobSystem gives
+//		 by default, and everything else as ParticleSystem sets it up
+//------------------------------------------------------------------------------
+void GetDefaultTuning( ClothTuning& tuning )
+{
+	tuning.numThreads		= std::min( GetNumProcessors() - 1, int( JobSystem::MAX_THREADS ) );
+	tuning.tileDim			= ParticleSystem::DEFAULT_TILE_DIM;
+	tuning.specialisation	= true;
+	tuning.storage			= STORE_FLOAT;
+	tuning.stepMs			= 0.0f;
+	tuning.maxDrift			= 0.0f;
+	tuning.cached			= false;
+}
+
+//------------------------------------------------------------------------------
+// Name: CreateCloth()
+// Desc: Makes a grid or mesh cloth kept in the given storage
+//------------------------------------------------------------------------------
+static ParticleSystem* CreateCloth( const int prtsPerDim, const ClothMesh* pMesh,
+									JobSystem* pJobs, const IntegratorStorage storage )
+{
+	if( pMesh != NULL )
+		return new ParticleSystem( *pMesh, pJobs, storage );
+
+	return new ParticleSystem( prtsPerDim, pJobs, storage );
+}
+
+//------------------------------------------------------------------------------
+// Name: MeasureTuning()
+// Desc: Steps a cloth set up as the candidate says on its own workers, and
+//		 records how long a step took and how far the cloth strayed from the
+//		 reference, which has been stepped as many times
+//------------------------------------------------------------------------------
+static void MeasureTuning( const int prtsPerDim, const ClothMesh* pMesh,
+						   const ParticleSystem& reference, ClothTuning& candidate )
+{
+	JobSystem jobs( candidate.numThreads );
+	ParticleSystem* const pCloth = CreateCloth( prtsPerDim, pMesh, &jobs, candidate.storage );
+	pCloth->SetTileDim( candidate.tileDim );
+	pCloth->SetSpecialisation( candidate.specialisation );
+
+	std::vector< CLOTH_VERTEX > vertices( pCloth->GetMaxParticles() );
+
+	for( int step = 0; step < TUNE_WARMUP_STEPS; ++step )
+	{
+		pCloth->BeginTimeStep( jobs, &vertices[ 0 ] );
+		pCloth->EndTimeStep( jobs );
+	}
+
+	double best = 1e30;
+	for( int round = 0; round < TUNE_ROUNDS; ++round )
+	{
+		const double start = GetSeconds();
+		for( int step = 0; step < TUNE_ROUND_STEPS; ++step )
+		{
+			pCloth->BeginTimeStep( jobs, &vertices[ 0 ] );
+			pCloth->EndTimeStep( jobs );
+		}
+		best = std::min( best, GetSeconds() - start );
+	}
+
+	candidate.stepMs	= float( best * 1000.0 / TUNE_ROUND_STEPS );
+	candidate.maxDrift	= 0.0f;
+	for( int p = 0; p < pCloth->GetNumParticles(); ++p )
+	{
+		const D3DXVECTOR3 vDrift = pCloth->GetParticlePosition( p ) -
+								   reference.GetParticlePosition( p );
+		candidate.maxDrift = std::max( candidate.maxDrift, D3DXVec3Length( &vDrift ) );
+	}
+
+	delete pCloth;
+}
+
+//------------------------------------------------------------------------------
+// Name: TryTuning()
+// Desc: Measures a candidate and keeps it as the best of its stage if it is
+//		 accurate enough and faster than the best so far
+//------------------------------------------------------------------------------
+static void TryTuning( const int prtsPerDim, const ClothMesh* pMesh,
+					   const ParticleSystem& reference, ClothTuning candidate,
+					   ClothTuning& best, bool& found )
+{
+	MeasureTuning( prtsPerDim, pMesh, reference, candidate );
+
+	if( candidate.maxDrift <= TUNE_TOLERANCE && ( !found || candidate.stepMs < best.stepMs ) )
+	{
+		best	= candidate;
+		found	= true;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: MeasureBestTuning()
+// Desc: Tunes one setting at a time, each stage starting from the winner of
+//		 the last: the kernel and storage, then the tile size, then the
+//		 number of workers, which most depends on the others. The solver is
+//		 left as it is set. XPBD, over-relaxation and Chebyshev change how far
+//		 each iteration converges, so they trade against the iteration count
+//		 rather than racing at the same one, and the constraint batches are
+//		 fixed by the mesh.
+//------------------------------------------------------------------------------
+static void MeasureBestTuning( const int prtsPerDim, const ClothMesh* pMesh,
+							   ClothTuning& tuning )
+{
+	GetDefaultTuning( tuning );
+
+	//everything is held to the default configuration's cloth
+	ParticleSystem* const pReference = CreateCloth( prtsPerDim, pMesh, NULL, STORE_FLOAT );
+	for( int step = 0; step < TUNE_WARMUP_STEPS + ( TUNE_ROUNDS * TUNE_ROUND_STEPS ); ++step )
+		pReference->TimeStep();
+
+	const bool hasKernel = pReference->IsSpecialised();
+	const int numStorage = sizeof( TUNE_STORAGE ) / sizeof( TUNE_STORAGE[ 0 ] );
+	const int numTileDims = sizeof( TUNE_TILE_DIMS ) / sizeof( TUNE_TILE_DIMS[ 0 ] );
+
+	//the default always passes, so each stage finds something
+	ClothTuning best = tuning;
+	bool found = false;
+	for( int kernel = 0; kernel < ( hasKernel ? 2 : 1 ); ++kernel )
+	{
+		for( int storage = 0; storage < numStorage; ++storage )
+		{
+			ClothTuning candidate		= tuning;
+			candidate.specialisation	= ( kernel == 0 );
+			candidate.storage			= TUNE_STORAGE[ storage ];
+			TryTuning( prtsPerDim, pMesh, *pReference, candidate, best, found );
+		}
+	}
+	tuning = best;
+
+	found = false;
+	for( int tile = 0; tile < numTileDims; ++tile )
+	{
+		ClothTuning candidate	= tuning;
+		candidate.tileDim		= TUNE_TILE_DIMS[ tile ];
+		TryTuning( prtsPerDim, pMesh, *pReference, candidate, best, found );
+	}
+	tuning = best;
+
+	//no workers, then doubling up to one for each processor after the first
+	const int maxThreads = std::min( GetNumProcessors() - 1, int( JobSystem::MAX_THREADS ) );
+	found = false;
+	for( int threads = 0; ; threads = std::min( ( threads * 2 ) + 1, maxThreads ) )
+	{
+		ClothTuning candidate	= tuning;
+		candidate.numThreads	= threads;
+		TryTuning( prtsPerDim, pMesh, *pReference, candidate, best, found );
+
+		if( threads == maxThreads )
+			break;
+	}
+	tuning = best;
+
+	delete pReference;
+}
+
+//------------------------------------------------------------------------------
+// Name: GetTuningFile()
+// Desc: Builds the name of this machine's tuning file, beside the program
+//------------------------------------------------------------------------------
+static void GetTuningFile( char* filename, const int size )
+{
+	char path[ MAX_PATH ];
+	const DWORD length = GetModuleFileName( NULL, path, MAX_PATH );
+	path[ std::min( int( length ), MAX_PATH - 1 ) ] = '\0';
+
+	char* pSlash = strrchr( path, '\\' );
+	if( pSlash != NULL )
+		pSlash[ 1 ] = '\0';
+	else
+		path[ 0 ] = '\0';
+
+	char computer[ MAX_COMPUTERNAME_LENGTH + 1 ];
+	DWORD computerLength = sizeof( computer );
+	if( !GetComputerName( computer, &computerLength ) )
+		strcpy( computer, "host" );
+
+	_snprintf( filename, size, "%sClothTuning-%s.ini", path, computer );
+	filename[ size - 1 ] = '\0';
+}
+
+//------------------------------------------------------------------------------
+// Name: ReadTuning()
+// Desc: Reads back a tuning from the file, returning false if there is none
+//		 for this cloth or it was made for another version or processor count
+//------------------------------------------------------------------------------
+static bool ReadTuning( const char* filename, const char* section, ClothTuning& tuning )
+{
+	if( int( GetPrivateProfileInt( section, "version", 0, filename ) ) != TUNE_CACHE_VERSION ||
+		int( GetPrivateProfileInt( section, "processors", 0, filename ) ) != GetNumProcessors() )
+		return false;
+
+	char value[ 32 ];
+	GetDefaultTuning( tuning );
+	tuning.numThreads		= GetPrivateProfileInt( section, "threads", tuning.numThreads, filename );
+	tuning.tileDim			= GetPrivateProfileInt( section, "tileDim", tuning.tileDim, filename );
+	tuning.specialisation	= GetPrivateProfileInt( section, "specialisation", 1, filename ) != 0;
+	tuning.storage			= IntegratorStorage( GetPrivateProfileInt( section, "storage",
+																	   STORE_FLOAT, filename ) );
+	GetPrivateProfileString( section, "stepMs", "0", value, sizeof( value ), filename );
+	tuning.stepMs			= float( atof( value ) );
+	GetPrivateProfileString( section, "maxDrift", "0", value, sizeof( value ), filename );
+	tuning.maxDrift			= float( atof( value ) );
+	tuning.cached			= true;
+
+	//anything out of range is the file's fault - tune again
+	return tuning.numThreads >= 0 && tuning.numThreads <= JobSystem::MAX_THREADS &&
+		   tuning.tileDim >= ParticleSystem::MIN_TILE_DIM &&
+		   tuning.tileDim <= ParticleSystem::MAX_TILE_DIM &&
+		   tuning.storage >= STORE_FLOAT && tuning.storage <= STORE_QUANTISED;
+}
+
+//------------------------------------------------------------------------------
+// Name: WriteTuning()
+// Desc: Keeps a tuning in the file under the cloth's section
+//------------------------------------------------------------------------------
+static void WriteTuning( const char* filename, const char* section, const ClothTuning& tuning )
+{
+	char value[ 32 ];
+
+	sprintf( value, "%d", TUNE_CACHE_VERSION );
+	WritePrivateProfileString( section, "version", value, filename );
+	sprintf( value, "%d", GetNumProcessors() );
+	WritePrivateProfileString( section, "processors", value, filename );
+	sprintf( value, "%d", tuning.numThreads );
+	WritePrivateProfileString( section, "threads", value, filename );
+	sprintf( value, "%d", tuning.tileDim );
+	WritePrivateProfileString( section, "tileDim", value, filename );
+	sprintf( value, "%d", tuning.specialisation ? 1 : 0 );
+	WritePrivateProfileString( section, "specialisation", value, filename );
+	sprintf( value, "%d", int( tuning.storage ) );
+	WritePrivateProfileString( section, "storage", value, filename );
+	sprintf( value, "%g", tuning.stepMs );
+	WritePrivateProfileString( section, "stepMs", value, filename );
+	sprintf( value, "%g", tuning.maxDrift );
+	WritePrivateProfileString( section, "maxDrift", value, filename );
+}
+
+//------------------------------------------------------------------------------
+// Name: TuneCloth()
+// Desc: Reads the tuning for this cloth from the machine's file, measuring
+//		 and writing it first if it is not there
+//------------------------------------------------------------------------------
+void TuneCloth( const int prtsPerDim, const ClothMesh* pMesh, ClothTuning& tuning,
+				const bool retune )
+{
+	char filename[ MAX_PATH + 64 ];
+	GetTuningFile( filename, sizeof( filename ) );
+
+	//one section per cloth size
+	char section[ 64 ];
+	if( pMesh != NULL )
+		sprintf( section, "mesh %d %d", int( pMesh->positions.size() ),
+				 int( pMesh->indices.size() / 3 ) );
+	else
+		sprintf( section, "grid %d", prtsPerDim );
+
+	if( !retune && ReadTuning( filename, section, tuning ) )
+		return;
+
+	MeasureBestTuning( prtsPerDim, pMesh, tuning );
+	WriteTuning( filename, section, tuning );
+}
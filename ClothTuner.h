@@ -0,0 +1,57 @@
+//------------------------------------------------------------------------------
+// File: ClothTuner.h
+// Desc: Picks the fastest way to step a cloth on this machine, once
+//
+// Created: 18 October 2026 17:03:06
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_CLOTHTUNER_H
+#define INCLUSIONGUARD_CLOTHTUNER_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <windows.h>
+#include "ParticleSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+struct ClothMesh;
+
+//------------------------------------------------------------------------------
+// Name: struct ClothTuning
+// Desc: How to step a cloth of one size on this machine
+//------------------------------------------------------------------------------
+struct ClothTuning
+{
+	int					numThreads;		//workers beside the thread that waits
+	int					tileDim;
+	bool				specialisation;	//use the specialised grid kernels
+	IntegratorStorage	storage;
+	float				stepMs;			//per time step, as measured
+	float				maxDrift;		//furthest a particle strayed from the default
+	bool				cached;			//read back rather than measured
+};
+
+//the furthest any particle may stray from the default configuration's cloth
+//for a faster one to be chosen
+const float TUNE_TOLERANCE = 1e-3f;
+
+//fills the tuning for a grid of prtsPerDim, or for the mesh if pMesh is not
+//NULL. The first time on each machine it times the candidate configurations
+//against each other and keeps the fastest accurate one in a file beside the
+//program; after that it just reads the file. retune forces the timing.
+void TuneCloth( const int prtsPerDim, const ClothMesh* pMesh, ClothTuning& tuning,
+				const bool retune = false );
+
+//the tuning every cloth had before there was a tuner
+void GetDefaultTuning( ClothTuning& tuning );
+
+
+#endif //INCLUSIONGUARD_CLOTHTUNER_H
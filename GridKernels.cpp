@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------------
+// File: GridKernels.cpp
+// Desc: Registry of the specialised grid kernel instantiations
+//
+// Created: 18 October 2026 15:27:47
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include "GridKernels.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+#define GRID_KERNEL_ENTRY( dim, iterations )						\
+	{ dim, iterations,												\
+	  &GridKernel< dim, iterations >::SatisfyConstraints,			\
+	  &GridKernel< dim, iterations >::RelaxConstraints,				\
+	  &GridKernel< dim, iterations >::FillVertices }
+
+//the production resolutions - anything else runs on the generic path
+static const GridKernelEntry s_gridKernels[] =
+{
+	GRID_KERNEL_ENTRY( 32, 1 ),
+	GRID_KERNEL_ENTRY( 32, 2 ),
+	GRID_KERNEL_ENTRY( 64, 1 ),
+	GRID_KERNEL_ENTRY( 64, 2 ),
+	GRID_KERNEL_ENTRY( 128, 1 ),
+	GRID_KERNEL_ENTRY( 128, 2 ),
+};
+
+#undef GRID_KERNEL_ENTRY
+
+//------------------------------------------------------------------------------
+// Name: FindGridKernel()
+// Desc: Looks up the specialised kernel for a grid size and iteration count
+//------------------------------------------------------------------------------
+const GridKernelEntry* FindGridKernel( const int prtsPerDim, const int numIterations )
+{
+	const int numKernels = sizeof( s_gridKernels ) / sizeof( s_gridKernels[ 0 ] );
+
+	for( int i = 0; i < numKernels; ++i )
+	{
+		if( s_gridKernels[ i ].prtsPerDim == prtsPerDim &&
+			s_gridKernels[ i ].numIterations == numIterations )
+			return &s_gridKernels[ i ];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,412 @@
+//------------------------------------------------------------------------------
+// File: GridKernels.h
+// Desc: Compile-time specialised step kernels for regular cloth grids
+//
+// Created: 18 October 2026 15:27:47
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_GRIDKERNELS_H
+#define INCLUSIONGUARD_GRIDKERNELS_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <float.h>
+#include <d3dx9.h>
+#include "ParticleSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: struct GridKernelParams
+// Desc: Everything a grid kernel needs to step one cloth
+//------------------------------------------------------------------------------
+struct GridKernelParams
+{
+	D3DXVECTOR3*	pPos;			//particle positions, row-major
+	float			space;			//rest distance between neighbours
+	float			diagonal;		//rest length of the shear constraints
+	D3DXVECTOR3		spherePosition;	//collision sphere center
+	float			sphereMinLength;//collision sphere radius plus edge correction
+	const ClothTile*	pTiles;			//particle tiles
+	int					numTiles;
+	D3DXVECTOR3*		pTileMin;		//tile bounds, refitted as they collide
+	D3DXVECTOR3*		pTileMax;
+	bool*				pTileActive;	//did each tile reach the sphere?
+	int*				pTileTests;		//particle tests each tile has run
+};
+
+typedef void (*SatisfyGridFn)( const GridKernelParams& params );
+typedef void (*FillGridFn)( const D3DXVECTOR3* pPos, CLOTH_VERTEX* pBuffer );
+
+//------------------------------------------------------------------------------
+// Name: struct GridKernelEntry
+// Desc: One specialised instantiation in the kernel registry
+//------------------------------------------------------------------------------
+struct GridKernelEntry
+{
+	int				prtsPerDim;
+	int				numIterations;
+	SatisfyGridFn	pfnSatisfyConstraints;
+	SatisfyGridFn	pfnRelaxConstraints;		//one iteration, no collision
+	FillGridFn		pfnFillVertices;
+};
+
+//returns the specialised kernel for a grid, or NULL to use the generic path
+const GridKernelEntry* FindGridKernel( const int prtsPerDim, const int numIterations );
+
+//------------------------------------------------------------------------------
+// Name: RelaxConstraint()
+// Desc: Moves two particles halfway each towards their rest distance, or by
+//		 scale of the way for over-relaxation, and returns the distance they
+//		 started at
+//------------------------------------------------------------------------------
+inline float RelaxConstraint( D3DXVECTOR3& v1, D3DXVECTOR3& v2, const float restLength,
+							  const float scale = 0.5f )
+{
+	//calculate the constraint
+	D3DXVECTOR3 vDelta	= v2 - v1;
+	float deltaLength	= D3DXVec3Length( &vDelta );
+	float difference	= ( deltaLength - restLength ) / deltaLength;
+
+	//move the particles to meet the constraint
+	difference *= scale;
+	v1 += vDelta * difference;
+	v2 -= vDelta * difference;
+
+	return deltaLength;
+}
+
+//------------------------------------------------------------------------------
+// Name: RelaxCompliantConstraint()
+// Desc: One XPBD update of a constraint between two particles of equal mass,
+//		 given its compliance over the squared substep and the multiplier it
+//		 has built up this substep. Returns the distance the particles started
+//		 at. With no compliance the first update is RelaxConstraint()'s.
+//------------------------------------------------------------------------------
+inline float RelaxCompliantConstraint( D3DXVECTOR3& v1, D3DXVECTOR3& v2,
+									   const float restLength, const float alphaTilde,
+									   float& lambda )
+{
+	D3DXVECTOR3 vDelta	= v2 - v1;
+	float deltaLength	= D3DXVec3Length( &vDelta );
+
+	//the change in the multiplier, for unit inverse masses
+	const float deltaLambda = ( restLength - deltaLength - alphaTilde * lambda ) /
+							  ( 2.0f + alphaTilde );
+	lambda += deltaLambda;
+
+	//move the particles along the constraint by it
+	const float move = deltaLambda / deltaLength;
+	v1 -= vDelta * move;
+	v2 += vDelta * move;
+
+	return deltaLength;
+}
+
+//------------------------------------------------------------------------------
+// Name: CollideSphere()
+// Desc: Pushes a particle out onto the surface of a sphere
+//------------------------------------------------------------------------------
+inline void CollideSphere( D3DXVECTOR3& v1, const D3DXVECTOR3& spherePosition,
+						   const float minLength )
+{
+	//calculate the constraint
+	D3DXVECTOR3 vDelta	= spherePosition - v1;
+	float deltaLength	= D3DXVec3Length( &vDelta );
+
+	//if point is inside the sphere, place it on the surface
+	if( deltaLength < minLength )
+	{
+		float difference = ( deltaLength - minLength ) / deltaLength;
+		v1 += vDelta * difference;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: AttachParticle()
+// Desc: Pulls a particle back to within maxLength of its anchor, leaving it
+//		 alone if it is already that close. There is no branch: the excess is
+//		 clamped at zero through its absolute value, so a particle in reach,
+//		 or one at FLT_MAX that no anchor reaches, moves by exactly nothing,
+//		 and FLT_MIN keeps a particle sitting on its anchor from dividing by
+//		 zero.
+//------------------------------------------------------------------------------
+inline void AttachParticle( D3DXVECTOR3& v1, const D3DXVECTOR3& anchorPosition,
+							const float maxLength )
+{
+	const D3DXVECTOR3 vDelta	= v1 - anchorPosition;
+	const float length			= D3DXVec3Length( &vDelta );
+	const float excess			= length - maxLength;
+
+	v1 -= vDelta * ( ( 0.5f * ( excess + fabsf( excess ) ) ) / ( length + FLT_MIN ) );
+}
+
+//------------------------------------------------------------------------------
+// Name: FitTile()
+// Desc: Fits a box around a tile's particles as they are now
+//------------------------------------------------------------------------------
+inline void FitTile( const D3DXVECTOR3* pPos, const ClothTile& tile,
+					 D3DXVECTOR3& vMin, D3DXVECTOR3& vMax )
+{
+	vMin = pPos[ tile.first ];
+	vMax = vMin;
+	for( int row = 0; row < tile.rows; ++row )
+	{
+		const D3DXVECTOR3* const pRow = pPos + tile.first + ( row * tile.stride );
+		for( int column = 0; column < tile.columns; ++column )
+		{
+			D3DXVec3Minimize( &vMin, &vMin, &pRow[ column ] );
+			D3DXVec3Maximize( &vMax, &vMax, &pRow[ column ] );
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: BoxReachesSphere()
+// Desc: Is any point of the box closer than minLength to the sphere center?
+//		 Each axis's gap to the box is no larger than to any point inside it,
+//		 so a box that misses holds no particle CollideSphere() would move.
+//		 The slack covers the particle test rounding its length differently.
+//------------------------------------------------------------------------------
+inline bool BoxReachesSphere( const D3DXVECTOR3& vMin, const D3DXVECTOR3& vMax,
+							  const D3DXVECTOR3& spherePosition, const float minLength )
+{
+	float distanceSq = 0.0f;
+	for( int axis = 0; axis < 3; ++axis )
+	{
+		float d = 0.0f;
+		if( spherePosition[ axis ] < vMin[ axis ] )
+			d = vMin[ axis ] - spherePosition[ axis ];
+		else if( spherePosition[ axis ] > vMax[ axis ] )
+			d = spherePosition[ axis ] - vMax[ axis ];
+		distanceSq += d * d;
+	}
+
+	const float reach = minLength * 1.001f;
+	return distanceSq < reach * reach;
+}
+
+//------------------------------------------------------------------------------
+// Name: CollideTiles()
+// Desc: Pushes the particles of a run of tiles out of a sphere. Each tile's
+//		 box is refitted to where its particles are now, after everything
+//		 that moved them this iteration, and the tile is skipped only if the
+//		 box misses the sphere - so the culling never changes the result.
+//		 The boxes and whether each tile reached the sphere are kept, and
+//		 each tile's count of particle tests goes up by those it ran.
+//------------------------------------------------------------------------------
+inline void CollideTiles( D3DXVECTOR3* pPos, const ClothTile* pTiles, const int numTiles,
+						  const D3DXVECTOR3& spherePosition, const float minLength,
+						  D3DXVECTOR3* pTileMin, D3DXVECTOR3* pTileMax, bool* pTileActive,
+						  int* pTileTests )
+{
+	for( int i = 0; i < numTiles; ++i )
+	{
+		const ClothTile& tile = pTiles[ i ];
+		pTileActive[ i ] = false;
+		if( tile.columns == 0 )
+			continue;
+
+		FitTile( pPos, tile, pTileMin[ i ], pTileMax[ i ] );
+		if( !BoxReachesSphere( pTileMin[ i ], pTileMax[ i ], spherePosition, minLength ) )
+			continue;
+
+		pTileActive[ i ] = true;
+		pTileTests[ i ] += tile.rows * tile.columns;
+		for( int row = 0; row < tile.rows; ++row )
+		{
+			D3DXVECTOR3* const pRow = pPos + tile.first + ( row * tile.stride );
+			for( int column = 0; column < tile.columns; ++column )
+				CollideSphere( pRow[ column ], spherePosition, minLength );
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: GetFaceNormal()
+// Desc: Returns the face normal of a given triangle
+//------------------------------------------------------------------------------
+inline D3DXVECTOR3 GetFaceNormal( const D3DXVECTOR3& v1, const D3DXVECTOR3& v2,
+								  const D3DXVECTOR3& v3 )
+{
+	D3DXVECTOR3 e1 = v2 - v1;
+	D3DXVECTOR3 e2 = v3 - v2;
+	D3DXVECTOR3 vNormal;
+
+	D3DXVec3Cross( &vNormal, &e1, &e2 );
+	D3DXVec3Normalize( &vNormal, &vNormal );
+
+	return vNormal;
+}
+
+//------------------------------------------------------------------------------
+// Name: GetGridNormal()
+// Desc: Returns the vertex normal of a grid particle, checking the grid edges
+//------------------------------------------------------------------------------
+inline D3DXVECTOR3 GetGridNormal( const D3DXVECTOR3* pPos, const int row,
+								  const int column, const int prtsPerDim )
+{
+	const int particle = column + ( row * prtsPerDim );
+	D3DXVECTOR3 vertexNormal = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
+
+	//upper left face...
+	if( column != 0 && row != 0 )
+		vertexNormal += GetFaceNormal( pPos[ particle ],
+									   pPos[ particle - prtsPerDim ],
+									   pPos[ particle - 1 ] );
+
+	//upper right face...
+	if( column != ( prtsPerDim - 1 ) && row != 0 )
+		vertexNormal += GetFaceNormal( pPos[ particle ],
+									   pPos[ particle + 1 ],
+									   pPos[ particle - prtsPerDim ] );
+
+	//lower left face...
+	if( column != 0 && row != ( prtsPerDim - 1 ) )
+		vertexNormal += GetFaceNormal( pPos[ particle ],
+									   pPos[ particle - 1 ],
+									   pPos[ particle + prtsPerDim ] );
+
+	//lower right face...
+	if( column != ( prtsPerDim - 1 ) && row != ( prtsPerDim - 1 ) )
+		vertexNormal += GetFaceNormal( pPos[ particle ],
+									   pPos[ particle + prtsPerDim ],
+									   pPos[ particle + 1 ] );
+
+	//normalize result
+	D3DXVec3Normalize( &vertexNormal, &vertexNormal );
+
+	return vertexNormal;
+}
+
+//------------------------------------------------------------------------------
+// Name: struct GridKernel
+// Desc: Step kernels with the grid size and iteration count fixed at compile
+//		 time, so the stencils unroll and the edge tests drop out of the
+//		 interior loops. Constraints are visited in the same order as the
+//		 generic path so both produce the same results.
+//------------------------------------------------------------------------------
+template< int PRTS_PER_DIM, int NUM_ITERATIONS >
+struct GridKernel
+{
+	static void SatisfyConstraints( const GridKernelParams& params )
+	{
+		for( int iteration = 0; iteration < NUM_ITERATIONS; ++iteration )
+		{
+			RelaxConstraints( params );
+
+			//constrain points to be outside the sphere
+			CollideTiles( params.pPos, params.pTiles, params.numTiles,
+						  params.spherePosition, params.sphereMinLength,
+						  params.pTileMin, params.pTileMax, params.pTileActive,
+						  params.pTileTests );
+		}
+	}
+
+	//one pass over every distance constraint, without the sphere
+	static void RelaxConstraints( const GridKernelParams& params )
+	{
+		D3DXVECTOR3* const pPos = params.pPos;
+		const float space		= params.space;
+		const float diagonal	= params.diagonal;
+		const float bend		= params.space * 2.0f;
+
+		//one step along rows
+		for( int row = 0; row < PRTS_PER_DIM; ++row )
+		{
+			D3DXVECTOR3* const pRow = pPos + ( row * PRTS_PER_DIM );
+			for( int column = 0; column < ( PRTS_PER_DIM - 1 ); ++column )
+				RelaxConstraint( pRow[ column ], pRow[ column + 1 ], space );
+		}
+
+		//one step along columns
+		for( int i = 0; i < ( PRTS_PER_DIM - 1 ) * PRTS_PER_DIM; ++i )
+			RelaxConstraint( pPos[ i ], pPos[ i + PRTS_PER_DIM ], space );
+
+		//one diagonal step
+		for( int row = 0; row < ( PRTS_PER_DIM - 1 ); ++row )
+		{
+			D3DXVECTOR3* const pRow = pPos + ( row * PRTS_PER_DIM );
+			for( int column = 1; column < PRTS_PER_DIM; ++column )
+				RelaxConstraint( pRow[ column ], pRow[ column + PRTS_PER_DIM - 1 ],
+								 diagonal );
+		}
+
+		//two steps along rows
+		for( int row = 0; row < PRTS_PER_DIM; ++row )
+		{
+			D3DXVECTOR3* const pRow = pPos + ( row * PRTS_PER_DIM );
+			for( int column = 0; column < ( PRTS_PER_DIM - 2 ); ++column )
+				RelaxConstraint( pRow[ column ], pRow[ column + 2 ], bend );
+		}
+
+		//two steps along columns
+		for( int i = 0; i < ( PRTS_PER_DIM - 2 ) * PRTS_PER_DIM; ++i )
+			RelaxConstraint( pPos[ i ], pPos[ i + PRTS_PER_DIM * 2 ], bend );
+	}
+
+	static void FillVertices( const D3DXVECTOR3* pPos, CLOTH_VERTEX* pBuffer )
+	{
+		const int LAST = PRTS_PER_DIM - 1;
+
+		//the edges are missing faces, so they take the general normal
+		for( int column = 0; column < PRTS_PER_DIM; ++column )
+		{
+			FillVertex( pBuffer, pPos, 0, column, GetGridNormal( pPos, 0, column, PRTS_PER_DIM ) );
+			FillVertex( pBuffer, pPos, LAST, column,
+						GetGridNormal( pPos, LAST, column, PRTS_PER_DIM ) );
+		}
+
+		for( int row = 1; row < LAST; ++row )
+		{
+			FillVertex( pBuffer, pPos, row, 0, GetGridNormal( pPos, row, 0, PRTS_PER_DIM ) );
+
+			//interior particles - all four faces exist
+			for( int column = 1; column < LAST; ++column )
+				FillVertex( pBuffer, pPos, row, column, GetInteriorNormal( pPos, row, column ) );
+
+			FillVertex( pBuffer, pPos, row, LAST, GetGridNormal( pPos, row, LAST, PRTS_PER_DIM ) );
+		}
+	}
+
+private:
+	static D3DXVECTOR3 GetInteriorNormal( const D3DXVECTOR3* pPos, const int row,
+										  const int column )
+	{
+		const int particle		= column + ( row * PRTS_PER_DIM );
+		const D3DXVECTOR3& v	= pPos[ particle ];
+
+		D3DXVECTOR3 vertexNormal;
+		vertexNormal  = GetFaceNormal( v, pPos[ particle - PRTS_PER_DIM ], pPos[ particle - 1 ] );
+		vertexNormal += GetFaceNormal( v, pPos[ particle + 1 ], pPos[ particle - PRTS_PER_DIM ] );
+		vertexNormal += GetFaceNormal( v, pPos[ particle - 1 ], pPos[ particle + PRTS_PER_DIM ] );
+		vertexNormal += GetFaceNormal( v, pPos[ particle + PRTS_PER_DIM ], pPos[ particle + 1 ] );
+		D3DXVec3Normalize( &vertexNormal, &vertexNormal );
+
+		return vertexNormal;
+	}
+
+	static void FillVertex( CLOTH_VERTEX* pBuffer, const D3DXVECTOR3* pPos, const int row,
+							const int column, const D3DXVECTOR3& vertexNormal )
+	{
+		const float TEXTURE_SPACE = 1.0f / ( PRTS_PER_DIM - 1 );
+
+		const int particle	= column + ( row * PRTS_PER_DIM );
+		CLOTH_VERTEX& out	= pBuffer[ particle ];
+		out.p	= pPos[ particle ];
+		out.n	= vertexNormal;
+		out.tu	= TEXTURE_SPACE * column;
+		out.tv	= TEXTURE_SPACE * row;
+	}
+};
+
+
+#endif //INCLUSIONGUARD_GRIDKERNELS_H
@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// File: Integrators.cpp
+// Desc: Registry of the integrator instantiations
+//
+// Created: 18 October 2026 16:30:46
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+
+//the integrators round each operation on its own, as ParticleSystem.cpp does
+#if defined( _MSC_VER ) && _MSC_VER >= 1400
+#pragma fp_contract( off )
+#endif
+
+#include "Integrators.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+#define INTEGRATOR_ENTRY( storage, precision, state, real, name )	\
+	{ storage, precision, name, sizeof( state ),						\
+	  state::DEFERRED ? int( sizeof( D3DXVECTOR3 ) ) : 0,				\
+	  &Integrator< state, real >::Integrate,							\
+	  state::DEFERRED ? &Integrator< state, real >::Commit : NULL,	\
+	  &Integrator< state, real >::GetOld,								\
+	  &Integrator< state, real >::SetOld }
+
+//every storage format in float and double arithmetic, except that double
+//storage only makes sense with double arithmetic
+static const IntegratorEntry s_integrators[] =
+{
+	INTEGRATOR_ENTRY( STORE_FLOAT, COMPUTE_FLOAT, FloatState, float, "float, float" ),
+	INTEGRATOR_ENTRY( STORE_FLOAT, COMPUTE_DOUBLE, FloatState, double, "float, double" ),
+	INTEGRATOR_ENTRY( STORE_HALF, COMPUTE_FLOAT, HalfState, float, "half, float" ),
+	INTEGRATOR_ENTRY( STORE_HALF, COMPUTE_DOUBLE, HalfState, double, "half, double" ),
+	INTEGRATOR_ENTRY( STORE_QUANTISED, COMPUTE_FLOAT, QuantisedState, float, "16-bit, float" ),
+	INTEGRATOR_ENTRY( STORE_QUANTISED, COMPUTE_DOUBLE, QuantisedState, double, "16-bit, double" ),
+	INTEGRATOR_ENTRY( STORE_DOUBLE, COMPUTE_DOUBLE, DoubleState, double, "double, double" )
+};
+
+#undef INTEGRATOR_ENTRY
+
+//------------------------------------------------------------------------------
+// Name: FindIntegrator()
+// Desc: Looks up the integrator for a storage format and precision
+//------------------------------------------------------------------------------
+const IntegratorEntry* FindIntegrator( const IntegratorStorage storage,
+									   const IntegratorPrecision precision )
+{
+	for( int i = 0; i < GetNumIntegrators(); ++i )
+	{
+		if( s_integrators[ i ].storage == storage &&
+			s_integrators[ i ].precision == precision )
+			return &s_integrators[ i ];
+	}
+
+	return NULL;
+}
+
+//------------------------------------------------------------------------------
+// Name: GetNumIntegrators()
+// Desc: Returns the number of integrators in the registry
+//------------------------------------------------------------------------------
+int GetNumIntegrators()
+{
+	return sizeof( s_integrators ) / sizeof( s_integrators[ 0 ] );
+}
+
+//------------------------------------------------------------------------------
+// Name: GetIntegrator()
+// Desc: Returns one integrator from the registry, for benchmarking them all
+//------------------------------------------------------------------------------
+const IntegratorEntry& GetIntegrator( const int index )
+{
+	return s_integrators[ index ];
+}
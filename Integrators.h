@@ -0,0 +1,317 @@
+//------------------------------------------------------------------------------
+// File: Integrators.h
+// Desc: Verlet integration over each storage format and precision
+//
+// Created: 18 October 2026 16:30:46
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_INTEGRATORS_H
+#define INCLUSIONGUARD_INTEGRATORS_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <d3dx9.h>
+#include "ParticleSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: struct IntegrateParams
+// Desc: Everything an integrator needs to step a run of particles
+//------------------------------------------------------------------------------
+struct IntegrateParams
+{
+	D3DXVECTOR3*	pPos;		//current positions, stepped in place
+	void*			pState;		//the integrator's state for each particle
+	D3DXVECTOR3*	pAcc;		//accumulated forces, then scratch until the commit
+	float			timeStep;
+	float			quantStep;	//length of one quantised unit
+	int				first;		//run of particles to step
+	int				count;
+};
+
+typedef void (*IntegrateFn)( const IntegrateParams& params );
+typedef D3DXVECTOR3 (*GetOldFn)( const void* pState, const D3DXVECTOR3* pPos,
+								 const int particle, const float quantStep );
+typedef void (*SetOldFn)( void* pState, const D3DXVECTOR3* pPos, const int particle,
+						  const D3DXVECTOR3& vOld, const float quantStep );
+
+//------------------------------------------------------------------------------
+// Name: struct IntegratorEntry
+// Desc: One instantiation in the integrator registry
+//------------------------------------------------------------------------------
+struct IntegratorEntry
+{
+	IntegratorStorage	storage;
+	IntegratorPrecision	precision;
+	const char*			name;
+	int					stateSize;		//bytes of state per particle
+	int					scratchSize;	//bytes per particle parked in the
+										//accelerations for the commit
+	IntegrateFn			pfnIntegrate;
+	IntegrateFn			pfnCommit;		//after the constraints, or NULL
+	GetOldFn			pfnGetOld;		//old position, for resampling
+	SetOldFn			pfnSetOld;		//set after the current position
+};
+
+//returns the integrator for a storage format and precision, or NULL if there
+//is no such combination
+const IntegratorEntry* FindIntegrator( const IntegratorStorage storage,
+									   const IntegratorPrecision precision );
+
+int GetNumIntegrators();
+const IntegratorEntry& GetIntegrator( const int index );
+
+//the largest offset quantised storage holds, in units of the quantisation step
+const int MAX_QUANTISED = 32767;
+
+//------------------------------------------------------------------------------
+// Name: struct FloatState
+// Desc: The old position, as it always was
+//------------------------------------------------------------------------------
+struct FloatState
+{
+	static const bool DEFERRED = false;
+
+	D3DXVECTOR3 old;
+
+	template< class REAL >
+	static void Load( const FloatState& s, const D3DXVECTOR3& p, REAL pos[ 3 ],
+					  REAL old[ 3 ], const float /*quantStep*/ )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			pos[ axis ] = REAL( p[ axis ] );
+			old[ axis ] = REAL( s.old[ axis ] );
+		}
+	}
+
+	template< class REAL >
+	static void Store( FloatState& s, D3DXVECTOR3& p, D3DXVECTOR3& /*vScratch*/,
+					   const REAL pos[ 3 ], const REAL next[ 3 ] )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			s.old[ axis ]	= float( pos[ axis ] );
+			p[ axis ]		= float( next[ axis ] );
+		}
+	}
+
+	static void SetOld( FloatState& s, const D3DXVECTOR3& /*p*/, const D3DXVECTOR3& vOld,
+						const float /*quantStep*/ )
+	{
+		s.old = vOld;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Name: struct HalfState
+// Desc: The old position as a half precision offset from the current one.
+//		 The offset is one step's movement, small enough for 16-bit floats
+//		 to hold to about three significant figures. It can only be taken
+//		 once the constraints have finished moving the current position, so
+//		 the step parks the full old position in the spent accelerations and
+//		 the commit encodes it. That writes and reads back twelve bytes a
+//		 particle, which the registry reports as its scratch.
+//------------------------------------------------------------------------------
+struct HalfState
+{
+	static const bool DEFERRED = true;
+
+	D3DXVECTOR3_16F offset;
+
+	template< class REAL >
+	static void Load( const HalfState& s, const D3DXVECTOR3& p, REAL pos[ 3 ],
+					  REAL old[ 3 ], const float /*quantStep*/ )
+	{
+		float offset[ 3 ];
+		D3DXFloat16To32Array( offset, &s.offset.x, 3 );
+
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			pos[ axis ] = REAL( p[ axis ] );
+			old[ axis ] = pos[ axis ] + REAL( offset[ axis ] );
+		}
+	}
+
+	template< class REAL >
+	static void Store( HalfState& /*s*/, D3DXVECTOR3& p, D3DXVECTOR3& vScratch,
+					   const REAL pos[ 3 ], const REAL next[ 3 ] )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			vScratch[ axis ]	= float( pos[ axis ] );
+			p[ axis ]			= float( next[ axis ] );
+		}
+	}
+
+	static void SetOld( HalfState& s, const D3DXVECTOR3& p, const D3DXVECTOR3& vOld,
+						const float /*quantStep*/ )
+	{
+		const D3DXVECTOR3 vOffset = vOld - p;
+		D3DXFloat32To16Array( &s.offset.x, &vOffset.x, 3 );
+	}
+};
+
+//------------------------------------------------------------------------------
+// Name: struct QuantisedState
+// Desc: The old position as a 16-bit fixed point offset from the current
+//		 one, in units of quantStep. Faster movement is clamped. Committed
+//		 after the constraints, like HalfState.
+//------------------------------------------------------------------------------
+struct QuantisedState
+{
+	static const bool DEFERRED = true;
+
+	short offset[ 3 ];
+
+	template< class REAL >
+	static void Load( const QuantisedState& s, const D3DXVECTOR3& p, REAL pos[ 3 ],
+					  REAL old[ 3 ], const float quantStep )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			pos[ axis ] = REAL( p[ axis ] );
+			old[ axis ] = pos[ axis ] + REAL( s.offset[ axis ] ) * REAL( quantStep );
+		}
+	}
+
+	template< class REAL >
+	static void Store( QuantisedState& /*s*/, D3DXVECTOR3& p, D3DXVECTOR3& vScratch,
+					   const REAL pos[ 3 ], const REAL next[ 3 ] )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			vScratch[ axis ]	= float( pos[ axis ] );
+			p[ axis ]			= float( next[ axis ] );
+		}
+	}
+
+	static void SetOld( QuantisedState& s, const D3DXVECTOR3& p, const D3DXVECTOR3& vOld,
+						const float quantStep )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			float units = ( vOld[ axis ] - p[ axis ] ) / quantStep;
+			units = units < -MAX_QUANTISED ? -MAX_QUANTISED :
+					units > MAX_QUANTISED ? MAX_QUANTISED : units;
+			s.offset[ axis ] = short( units < 0.0f ? units - 0.5f : units + 0.5f );
+		}
+	}
+};
+
+//------------------------------------------------------------------------------
+// Name: struct DoubleState
+// Desc: Double precision current and old positions. The float position the
+//		 rest of the solver works on is only a rounded copy; the constraints'
+//		 corrections to it are folded back in before each step, so the
+//		 integration itself never loses the low bits.
+//------------------------------------------------------------------------------
+struct DoubleState
+{
+	static const bool DEFERRED = false;
+
+	double pos[ 3 ];
+	double old[ 3 ];
+
+	template< class REAL >
+	static void Load( const DoubleState& s, const D3DXVECTOR3& p, REAL pos[ 3 ],
+					  REAL old[ 3 ], const float /*quantStep*/ )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			//what the constraints moved the rounded copy by since the last step
+			const double correction = double( p[ axis ] ) - double( float( s.pos[ axis ] ) );
+			pos[ axis ] = REAL( s.pos[ axis ] + correction );
+			old[ axis ] = REAL( s.old[ axis ] );
+		}
+	}
+
+	template< class REAL >
+	static void Store( DoubleState& s, D3DXVECTOR3& p, D3DXVECTOR3& /*vScratch*/,
+					   const REAL pos[ 3 ], const REAL next[ 3 ] )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			s.old[ axis ]	= double( pos[ axis ] );
+			s.pos[ axis ]	= double( next[ axis ] );
+			p[ axis ]		= float( next[ axis ] );
+		}
+	}
+
+	static void SetOld( DoubleState& s, const D3DXVECTOR3& p, const D3DXVECTOR3& vOld,
+						const float /*quantStep*/ )
+	{
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			s.pos[ axis ] = p[ axis ];
+			s.old[ axis ] = vOld[ axis ];
+		}
+	}
+};
+
+//------------------------------------------------------------------------------
+// Name: struct Integrator
+// Desc: Verlet integration with the old positions kept as STATE and the
+//		 arithmetic done in REAL. The float instantiation on FloatState gives
+//		 exactly the results of the original integrator.
+//------------------------------------------------------------------------------
+template< class STATE, class REAL >
+struct Integrator
+{
+	static void Integrate( const IntegrateParams& params )
+	{
+		STATE* const pState = (STATE*)params.pState;
+		const REAL timeStep = REAL( params.timeStep );
+
+		for( int i = params.first; i < params.first + params.count; ++i )
+		{
+			D3DXVECTOR3& vAcc = params.pAcc[ i ];
+
+			REAL pos[ 3 ], old[ 3 ], next[ 3 ];
+			STATE::Load( pState[ i ], params.pPos[ i ], pos, old, params.quantStep );
+
+			for( int axis = 0; axis < 3; ++axis )
+				next[ axis ] = pos[ axis ] + ( ( pos[ axis ] - old[ axis ] ) +
+											   REAL( vAcc[ axis ] ) * timeStep * timeStep );
+
+			STATE::Store( pState[ i ], params.pPos[ i ], vAcc, pos, next );
+		}
+	}
+
+	//encodes the old positions parked by a deferred state's Integrate()
+	static void Commit( const IntegrateParams& params )
+	{
+		STATE* const pState = (STATE*)params.pState;
+
+		for( int i = params.first; i < params.first + params.count; ++i )
+			STATE::SetOld( pState[ i ], params.pPos[ i ], params.pAcc[ i ], params.quantStep );
+	}
+
+	static D3DXVECTOR3 GetOld( const void* pState, const D3DXVECTOR3* pPos,
+							   const int particle, const float quantStep )
+	{
+		REAL pos[ 3 ], old[ 3 ];
+		STATE::Load( ( (const STATE*)pState )[ particle ], pPos[ particle ], pos, old,
+					 quantStep );
+
+		return D3DXVECTOR3( float( old[ 0 ] ), float( old[ 1 ] ), float( old[ 2 ] ) );
+	}
+
+	static void SetOld( void* pState, const D3DXVECTOR3* pPos, const int particle,
+						const D3DXVECTOR3& vOld, const float quantStep )
+	{
+		STATE::SetOld( ( (STATE*)pState )[ particle ], pPos[ particle ], vOld, quantStep );
+	}
+};
+
+
+#endif //INCLUSIONGUARD_INTEGRATORS_H
@@ -0,0 +1,308 @@
+//------------------------------------------------------------------------------
+// File: JobSystem.cpp
+// Desc: Worker threads running graphs of dependent jobs
+//
+// Created: 18 October 2026 16:15:47
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+#include <float.h>
+#include <algorithm>
+#include "JobSystem.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//ready jobs the ring starts with room for, doubled whenever it fills
+static const int INITIAL_READY_JOBS = 256;
+
+//the parts of the floating-point control word that change results. Direct3D
+//drops the x87 precision of the thread that creates the device, so without
+//this a job's result would depend on which thread ran it.
+#if defined( _M_IX86 )
+const unsigned int FLOAT_CONTROL_MASK = _MCW_RC | _MCW_PC;
+#else
+const unsigned int FLOAT_CONTROL_MASK = _MCW_RC;
+#endif
+#if defined( _MCW_DN )
+const unsigned int FLOAT_DENORMAL_MASK = _MCW_DN;
+#else
+const unsigned int FLOAT_DENORMAL_MASK = 0;
+#endif
+
+//------------------------------------------------------------------------------
+// Name: JobGraph()
+// Desc: Constructor for an empty job graph
+//------------------------------------------------------------------------------
+JobGraph::JobGraph()
+{
+	m_numRemaining	= 0;
+	m_hDone			= CreateEvent( NULL, FALSE, FALSE, NULL );
+	m_inheritFloat	= false;
+	m_floatControl	= 0;
+}
+
+//------------------------------------------------------------------------------
+// Name: ~JobGraph()
+// Desc: Destructor for the job graph
+//------------------------------------------------------------------------------
+JobGraph::~JobGraph()
+{
+	CloseHandle( m_hDone );
+}
+
+//------------------------------------------------------------------------------
+// Name: Clear()
+// Desc: Removes every job, keeping the memory for the next frame's graph
+//------------------------------------------------------------------------------
+void JobGraph::Clear()
+{
+	m_jobs.clear();
+	m_dependencies.clear();
+}
+
+//------------------------------------------------------------------------------
+// Name: AddJob()
+// Desc: Adds a job that calls pfnJob( pContext, param )
+//------------------------------------------------------------------------------
+int JobGraph::AddJob( const JobFn pfnJob, void* pContext, const int param )
+{
+	Job job;
+	job.pfnJob		= pfnJob;
+	job.pContext	= pContext;
+	job.param		= param;
+	m_jobs.push_back( job );
+
+	return int( m_jobs.size() ) - 1;
+}
+
+//------------------------------------------------------------------------------
+// Name: AddDependency()
+// Desc: Stops a job from starting until another has finished
+//------------------------------------------------------------------------------
+void JobGraph::AddDependency( const int job, const int dependsOn )
+{
+	Dependency d;
+	d.job		= job;
+	d.dependsOn	= dependsOn;
+	m_dependencies.push_back( d );
+}
+
+//------------------------------------------------------------------------------
+// Name: Prepare()
+// Desc: Turns the dependency list into successor lists, with a counting sort,
+//		 lists the jobs that depend on nothing and resets the counters for a run.
+//		 The lists keep their capacity, so a graph refilled the same way each
+//		 frame allocates nothing here.
+//------------------------------------------------------------------------------
+void JobGraph::Prepare()
+{
+	const int numJobs			= int( m_jobs.size() );
+	const int numDependencies	= int( m_dependencies.size() );
+
+	m_successorStart.assign( numJobs + 1, 0 );
+	m_successors.resize( numDependencies );
+	m_numPending.assign( numJobs, 0 );
+
+	for( int i = 0; i < numDependencies; ++i )
+	{
+		++m_successorStart[ m_dependencies[ i ].dependsOn + 1 ];
+		++m_numPending[ m_dependencies[ i ].job ];
+	}
+	for( int job = 0; job < numJobs; ++job )
+		m_successorStart[ job + 1 ] += m_successorStart[ job ];
+
+	//the starts are the cursors, which leaves each at the next job's start
+	for( int i = 0; i < numDependencies; ++i )
+		m_successors[ m_successorStart[ m_dependencies[ i ].dependsOn ]++ ] = m_dependencies[ i ].job;
+	for( int job = numJobs; job > 0; --job )
+		m_successorStart[ job ] = m_successorStart[ job - 1 ];
+	m_successorStart[ 0 ] = 0;
+
+	m_roots.clear();
+	for( int job = 0; job < numJobs; ++job )
+	{
+		if( m_numPending[ job ] == 0 )
+			m_roots.push_back( job );
+	}
+
+	m_numRemaining = numJobs;
+	ResetEvent( m_hDone );
+}
+
+//------------------------------------------------------------------------------
+// Name: JobSystem()
+// Desc: Constructor for the job system - starts the worker threads
+//------------------------------------------------------------------------------
+JobSystem::JobSystem( const int numThreads )
+{
+	m_numThreads = numThreads;
+	if( m_numThreads < 0 )
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo( &info );
+		m_numThreads = int( info.dwNumberOfProcessors ) - 1;
+	}
+	m_numThreads = std::max( 0, std::min( m_numThreads, int( MAX_THREADS ) ) );
+
+	m_quit		= 0;
+	m_hReady	= CreateSemaphore( NULL, 0, 0x7fffffff, NULL );
+
+	m_ready.resize( INITIAL_READY_JOBS );
+	m_readyFirst	= 0;
+	m_numReady		= 0;
+	InitializeCriticalSection( &m_lock );
+
+	for( int i = 0; i < m_numThreads; ++i )
+		m_threads[ i ] = CreateThread( NULL, 0, WorkerThread, this, 0, NULL );
+}
+
+//------------------------------------------------------------------------------
+// Name: ~JobSystem()
+// Desc: Destructor for the job system - stops the worker threads
+//------------------------------------------------------------------------------
+JobSystem::~JobSystem()
+{
+	//wake every worker to see the quit flag
+	InterlockedExchange( &m_quit, 1 );
+	ReleaseSemaphore( m_hReady, m_numThreads, NULL );
+
+	for( int i = 0; i < m_numThreads; ++i )
+	{
+		WaitForSingleObject( m_threads[ i ], INFINITE );
+		CloseHandle( m_threads[ i ] );
+	}
+
+	DeleteCriticalSection( &m_lock );
+	CloseHandle( m_hReady );
+}
+
+//------------------------------------------------------------------------------
+// Name: Submit()
+// Desc: Starts a graph running, by queueing the jobs with no dependencies
+//------------------------------------------------------------------------------
+void JobSystem::Submit( JobGraph& graph )
+{
+	graph.Prepare();
+	if( graph.m_inheritFloat )
+		graph.m_floatControl = _controlfp( 0, 0 ) & ( FLOAT_CONTROL_MASK | FLOAT_DENORMAL_MASK );
+
+	if( graph.m_numRemaining == 0 )
+	{
+		SetEvent( graph.m_hDone );
+		return;
+	}
+
+	//the roots were listed up front, as the counters change once jobs run
+	for( size_t i = 0; i < graph.m_roots.size(); ++i )
+		Push( &graph, graph.m_roots[ i ] );
+}
+
+//------------------------------------------------------------------------------
+// Name: Wait()
+// Desc: Helps run jobs until every job in the graph has finished. The count
+//		 reaching zero is not enough to return on - the worker that finished
+//		 the last job still has to signal m_hDone, and the graph may be
+//		 resubmitted or destroyed as soon as this returns. So this returns
+//		 only once it has taken that signal, which also leaves the
+//		 auto-reset event clear for the next submission.
+//------------------------------------------------------------------------------
+void JobSystem::Wait( JobGraph& graph )
+{
+	HANDLE handles[ 2 ] = { m_hReady, graph.m_hDone };
+
+	while( WaitForMultipleObjects( 2, handles, FALSE, INFINITE ) == WAIT_OBJECT_0 )
+		RunNext();
+}
+
+//------------------------------------------------------------------------------
+// Name: WorkerThread()
+// Desc: Runs ready jobs until the job system shuts down
+//------------------------------------------------------------------------------
+DWORD WINAPI JobSystem::WorkerThread( LPVOID pParam )
+{
+	JobSystem* const pJobs = (JobSystem*)pParam;
+
+	for( ;; )
+	{
+		WaitForSingleObject( pJobs->m_hReady, INFINITE );
+		if( pJobs->m_quit != 0 )
+			break;
+
+		pJobs->RunNext();
+	}
+
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+// Name: Push()
+// Desc: Queues a job whose dependencies have all finished
+//------------------------------------------------------------------------------
+void JobSystem::Push( JobGraph* pGraph, const int job )
+{
+	ReadyJob ready;
+	ready.pGraph	= pGraph;
+	ready.job		= job;
+
+	EnterCriticalSection( &m_lock );
+	if( m_numReady == int( m_ready.size() ) )
+	{
+		//unroll the full ring to the front of one twice the size
+		std::rotate( m_ready.begin(), m_ready.begin() + m_readyFirst, m_ready.end() );
+		m_ready.resize( m_ready.size() * 2 );
+		m_readyFirst = 0;
+	}
+	m_ready[ ( m_readyFirst + m_numReady ) % int( m_ready.size() ) ] = ready;
+	++m_numReady;
+	LeaveCriticalSection( &m_lock );
+
+	ReleaseSemaphore( m_hReady, 1, NULL );
+}
+
+//------------------------------------------------------------------------------
+// Name: RunNext()
+// Desc: Runs the job at the front of the queue and releases its successors.
+//		 The caller has already taken the job's count from m_hReady.
+//------------------------------------------------------------------------------
+void JobSystem::RunNext()
+{
+	EnterCriticalSection( &m_lock );
+	const ReadyJob ready = m_ready[ m_readyFirst ];
+	m_readyFirst = ( m_readyFirst + 1 ) % int( m_ready.size() );
+	--m_numReady;
+	LeaveCriticalSection( &m_lock );
+
+	JobGraph& graph = *ready.pGraph;
+	const JobGraph::Job& job = graph.m_jobs[ ready.job ];
+	if( job.pfnJob != NULL )
+	{
+		//the control word is only written when it differs, as that stalls
+		const unsigned int mask = FLOAT_CONTROL_MASK | FLOAT_DENORMAL_MASK;
+		if( graph.m_inheritFloat && ( _controlfp( 0, 0 ) & mask ) != graph.m_floatControl )
+			_controlfp( graph.m_floatControl, mask );
+
+		job.pfnJob( job.pContext, job.param );
+	}
+
+	//successors whose last dependency this was are ready now
+	const int first	= graph.m_successorStart[ ready.job ];
+	const int last	= graph.m_successorStart[ ready.job + 1 ];
+	for( int i = first; i < last; ++i )
+	{
+		const int successor = graph.m_successors[ i ];
+		if( InterlockedDecrement( &graph.m_numPending[ successor ] ) == 0 )
+			Push( &graph, successor );
+	}
+
+	if( InterlockedDecrement( &graph.m_numRemaining ) == 0 )
+		SetEvent( graph.m_hDone );
+}
@@ -0,0 +1,140 @@
+//------------------------------------------------------------------------------
+// File: JobSystem.h
+// Desc: Worker threads running graphs of dependent jobs
+//
+// Created: 18 October 2026 16:15:47
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+#ifndef INCLUSIONGUARD_JOBSYSTEM_H
+#define INCLUSIONGUARD_JOBSYSTEM_H
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#include <vector>
+#include <windows.h>
+
+
+//------------------------------------------------------------------------------
+// Prototypes and declarations:
+//------------------------------------------------------------------------------
+typedef void (*JobFn)( void* pContext, const int param );
+
+//------------------------------------------------------------------------------
+// Name: class JobGraph
+// Desc: A set of jobs and the dependencies between them. A job becomes ready
+//		 once every job it depends on has finished. The graph can be cleared
+//		 and refilled each frame without reallocating.
+//------------------------------------------------------------------------------
+class JobGraph
+{
+public:
+	JobGraph();
+	~JobGraph();
+
+	void Clear();
+
+	//adds a job, returning its number - a NULL function makes a barrier
+	int AddJob( const JobFn pfnJob, void* pContext, const int param );
+	int AddBarrier() { return AddJob( NULL, NULL, 0 ); }
+
+	//makes job wait for dependsOn to finish
+	void AddDependency( const int job, const int dependsOn );
+
+	//runs every job with the rounding, precision and denormal handling of
+	//the thread that submits the graph, rather than with whatever each
+	//worker happens to have
+	void SetInheritFloatingPoint( const bool inherit ) { m_inheritFloat = inherit; }
+
+	int GetNumJobs() const { return int( m_jobs.size() ); }
+	bool IsDone() const { return m_numRemaining == 0; }
+
+private:
+	friend class JobSystem;
+
+	struct Job
+	{
+		JobFn	pfnJob;
+		void*	pContext;
+		int		param;
+	};
+
+	struct Dependency
+	{
+		int job;
+		int dependsOn;
+	};
+
+	void Prepare();
+
+	std::vector< Job >			m_jobs;
+	std::vector< Dependency >	m_dependencies;
+
+	//built by Prepare() - the jobs waiting on each job, and how many jobs
+	//each one is still waiting for
+	std::vector< int >			m_successorStart;
+	std::vector< int >			m_successors;
+	std::vector< LONG >			m_numPending;
+	std::vector< int >			m_roots;
+
+	volatile LONG	m_numRemaining;
+	HANDLE			m_hDone;
+
+	bool			m_inheritFloat;
+	unsigned int	m_floatControl;		//the submitter's, when inherited
+};
+
+//------------------------------------------------------------------------------
+// Name: class JobSystem
+// Desc: A pool of worker threads sharing one queue of ready jobs. The thread
+//		 that waits on a graph runs jobs too, so a machine with one processor
+//		 needs no workers at all.
+//------------------------------------------------------------------------------
+class JobSystem
+{
+public:
+	const static int MAX_THREADS = 32;
+
+	//a negative count gives one worker for each processor after the first
+	JobSystem( const int numThreads = -1 );
+	~JobSystem();
+
+	//queues the jobs of a graph that depend on nothing
+	void Submit( JobGraph& graph );
+
+	//runs jobs until the graph has finished
+	void Wait( JobGraph& graph );
+
+	int GetNumThreads() const { return m_numThreads; }
+
+private:
+	struct ReadyJob
+	{
+		JobGraph*	pGraph;
+		int			job;
+	};
+
+	static DWORD WINAPI WorkerThread( LPVOID pParam );
+
+	void Push( JobGraph* pGraph, const int job );
+	void RunNext();
+
+	HANDLE				m_threads[ MAX_THREADS ];
+	int					m_numThreads;
+	volatile LONG		m_quit;
+
+	//a ring of ready jobs, grown only when full so that running a graph
+	//again allocates nothing
+	CRITICAL_SECTION		m_lock;		//guards the ring
+	std::vector< ReadyJob >	m_ready;
+	int						m_readyFirst;
+	int						m_numReady;
+	HANDLE					m_hReady;	//counts the jobs in the ring
+};
+
+
+#endif //INCLUSIONGUARD_JOBSYSTEM_H
@@ -11,14 +11,39 @@
 //------------------------------------------------------------------------------
 // Included files:
 //------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+
+//a multiply and add fused into one rounding would give results that differ
+//between compilers and processors, which deterministic stepping cannot have.
+//It is turned off here and in the other files the step runs through, ahead
+//of the headers whose inline functions the step calls.
+#if defined( _MSC_VER ) && _MSC_VER >= 1400
+#pragma fp_contract( off )
+#endif
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
 #include "ParticleSystem.h"
+#include "GridKernels.h"
+#include "Integrators.h"
+#include "ClothMesh.h"
 
 
 //------------------------------------------------------------------------------
 // Definitions:
 //------------------------------------------------------------------------------
-const float ParticleSystem::EDGE_CORRECTION = 0.3f / ParticleSystem::PRTS_PER_DIM;
+const float ParticleSystem::EDGE_CORRECTION = 0.3f / ParticleSystem::DEFAULT_PRTS_PER_DIM;
 const float ParticleSystem::SPHERE_RADIUS = 0.3f;
+const float ParticleSystem::DEFAULT_TEAR_STRAIN = 0.5f;
+const float ParticleSystem::DEFAULT_ATTACHMENT_STRETCH = 0.01f;
+const float ParticleSystem::DEFAULT_COMPLIANCE[ NUM_CONSTRAINT_TYPES ] =
+	{ 0.0f, 1e-7f, 1e-5f };	//rigid weave, a little shear, soft folds
+const float ParticleSystem::MAX_SPECTRAL_RADIUS = 0.99f;
+const float ParticleSystem::DIVERGENCE_RATIO = 1.1f;
 const D3DXVECTOR3 ParticleSystem::SPHERE_POSITION =
 	D3DXVECTOR3( 0.0f, - SPHERE_RADIUS - ParticleSystem::EDGE_CORRECTION, 0.0f );
 
@@ -26,21 +51,663 @@ const D3DXVECTOR3 ParticleSystem::SPHERE_POSITION =
 // Name: ParticleSystem()
 // Desc: Constructor for the cloth particle system
 //------------------------------------------------------------------------------
-ParticleSystem::ParticleSystem()
+ParticleSystem::ParticleSystem( const int prtsPerDim, JobSystem* pJobs,
+								const IntegratorStorage storage,
+								const IntegratorPrecision precision )
+{
+	//size the grid
+	m_prtsPerDim = prtsPerDim;
+	SelectIntegrator( storage, precision );
+	Allocate( prtsPerDim * prtsPerDim,
+			  ( ( prtsPerDim - 1 ) * prtsPerDim * 2 ) +
+			  ( ( prtsPerDim - 1 ) * ( prtsPerDim - 1 ) ) +
+			  ( ( prtsPerDim - 2 ) * prtsPerDim * 2 ),
+			  ( prtsPerDim - 1 ) * ( prtsPerDim - 1 ) * 2, 1, pJobs );
+	BuildGridTriangles();
+	BuildAdjacency();
+	m_indices.Build( m_triangles, m_numTriangles, m_numParticles );
+	m_restIndices = m_indices;
+
+	//initialise simulation values
+	m_gravity = D3DXVECTOR3( 0.0f, -2.0f, 0.0f );
+	m_timeStep = 0.002f;
+	m_numIterations = 1;
+	SelectKernel();
+
+	Initialise();
+}
+
+//------------------------------------------------------------------------------
+// Name: ParticleSystem()
+// Desc: Constructor for a particle system shaped like an arbitrary mesh
+//------------------------------------------------------------------------------
+ParticleSystem::ParticleSystem( const ClothMesh& mesh, JobSystem* pJobs,
+								const IntegratorStorage storage,
+								const IntegratorPrecision precision )
 {
+	//lay the particles out along a space-filling curve
+	ClothMesh sorted = mesh;
+	ReorderClothMesh( sorted );
+
+	//generate the constraints from the mesh edges, batched for locality
+	std::vector< ClothConstraint > constraints;
+	std::vector< ConstraintBatch > batches;
+	BuildMeshConstraints( sorted, constraints );
+	BatchConstraints( constraints, batches );
+
+	m_prtsPerDim = 0;
+	SelectIntegrator( storage, precision );
+	Allocate( int( sorted.positions.size() ), int( constraints.size() ),
+			  int( sorted.indices.size() / 3 ), int( batches.size() ), pJobs );
+
+	//keep the rest shape and topology to go back to after tearing
+	for( int i = 0; i < m_numRestParticles; ++i )
+	{
+		m_restPos[ i ]			= sorted.positions[ i ];
+		m_restTexCoords[ i ]	= sorted.texCoords[ i ];
+	}
+	for( int i = 0; i < m_numRestConstraints; ++i )
+		m_restConstraints[ i ] = constraints[ i ];
+	for( int i = 0; i < m_numRestBatches; ++i )
+		m_restBatches[ i ] = batches[ i ];
+	for( int i = 0; i < m_numTriangles * 3; ++i )
+	{
+		m_restTriangles[ i ]	= sorted.indices[ i ];
+		m_triangles[ i ]		= sorted.indices[ i ];
+	}
+	BuildAdjacency();
+	m_indices.Build( m_triangles, m_numTriangles, m_numRestParticles );
+	m_restIndices = m_indices;
+
+	//the particle nearest the middle of the cloth is the one to watch
+	D3DXVECTOR3 vCenter = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
+	for( int i = 0; i < m_numParticles; ++i )
+		vCenter += m_restPos[ i ];
+	vCenter /= float( m_numParticles );
+
+	float bestDistance = FLT_MAX;
+	m_constraintParticle = 0;
+	for( int i = 0; i < m_numParticles; ++i )
+	{
+		D3DXVECTOR3 vDelta = m_restPos[ i ] - vCenter;
+		const float distance = D3DXVec3LengthSq( &vDelta );
+		if( distance < bestDistance )
+		{
+			bestDistance = distance;
+			m_constraintParticle = i;
+		}
+	}
+
 	//initialise simulation values
+	m_particleSpace = 0.0f;
+	m_diagonalSpace = 0.0f;
+
+	//quantise to a share of the longest constraint
+	m_maxRestLength = 0.0f;
+	for( int i = 0; i < m_numRestConstraints; ++i )
+		m_maxRestLength = std::max( m_maxRestLength, m_restConstraints[ i ].restLength );
+	m_quantStep = m_maxRestLength / MAX_QUANTISED;
+
 	m_gravity = D3DXVECTOR3( 0.0f, -2.0f, 0.0f );
 	m_timeStep = 0.002f;
+	m_numIterations = 1;
+	SelectKernel();
 
 	Initialise();
 }
 
+//------------------------------------------------------------------------------
+// Name: Allocate()
+// Desc: Allocates the particle, constraint and triangle arrays, leaving room
+//		 for the particles that tearing splits off. They all come from the
+//		 arena, which is sized by a dry run of the same carving.
+//------------------------------------------------------------------------------
+void ParticleSystem::Allocate( const int numParticles, const int numConstraints,
+							   const int numTriangles, const int numBatches,
+							   JobSystem* pJobs )
+{
+	m_numRestParticles		= numParticles;
+	m_numRestConstraints	= numConstraints;
+	m_numRestBatches		= numBatches;
+	m_maxParticles			= numParticles + numParticles / 4;
+
+	m_numParticles		= numParticles;
+	m_numConstraints	= numConstraints;
+	m_numTriangles		= numTriangles;
+	m_numBatches		= numBatches;
+
+	//room for the tiles at the smallest size, so they can be recut
+	m_tileDim	= DEFAULT_TILE_DIM;
+	m_numTiles	= CountTiles( m_tileDim );
+	m_maxTiles	= CountTiles( MIN_TILE_DIM );
+
+	m_arena.BeginSizing();
+	CarveArrays();
+	m_arena.Reserve( ClothArena::LARGE_PAGES );
+	CarveArrays();
+
+	//place the pages before anything writes to them
+	if( pJobs != NULL )
+		m_arena.FirstTouch( *pJobs );
+
+	m_pStepVertices = NULL;
+
+	m_tearing			= false;
+	m_tearStrain		= DEFAULT_TEAR_STRAIN;
+	m_torn				= false;
+	m_numPendingTears	= 0;
+	m_numTears			= 0;
+
+	m_attachments	= true;
+	m_attachStretch	= DEFAULT_ATTACHMENT_STRETCH;
+
+	m_solver		= SOLVER_JAKOBSEN;
+	m_numSubsteps	= 1;
+	for( int type = 0; type < NUM_CONSTRAINT_TYPES; ++type )
+		m_compliance[ type ] = DEFAULT_COMPLIANCE[ type ];
+
+	m_overRelaxation	= 1.0f;
+	m_chebyshev			= false;
+	m_relaxScale		= 0.5f;
+	m_accelerating		= true;
+	m_chebyshevOmega	= 1.0f;
+	m_spectralRadius	= 0.5f;		//a cautious start until sweeps are measured
+	m_previousResidual	= 0.0f;
+	m_sweep				= 0;
+	m_sweepResidual		= 0.0;
+	memset( &m_solverStats, 0, sizeof( m_solverStats ) );
+
+	m_spherePosition	= SPHERE_POSITION;
+	m_sphereRadius		= SPHERE_RADIUS;
+
+	m_pKernel			= NULL;
+	m_specialisation	= true;
+	m_deterministic		= false;
+
+	BuildTiles();
+}
+
+//------------------------------------------------------------------------------
+// Name: CarveArrays()
+// Desc: Points every array at its piece of the arena. Only a mesh cloth
+//		 keeps its rest state; a grid rebuilds it.
+//------------------------------------------------------------------------------
+void ParticleSystem::CarveArrays()
+{
+	m_arena.Carve( m_pos, m_maxParticles );
+	m_arena.Carve( m_oldState, m_maxParticles * m_pIntegrator->stateSize );
+	m_arena.Carve( m_acc, m_maxParticles );
+	m_arena.Carve( m_iterates[ 0 ], m_maxParticles );
+	m_arena.Carve( m_iterates[ 1 ], m_maxParticles );
+	m_arena.Carve( m_texCoords, m_maxParticles );
+	m_arena.Carve( m_attachAnchor, m_maxParticles );
+	m_arena.Carve( m_attachLength, m_maxParticles );
+	m_arena.Carve( m_attachDistance, m_maxParticles );
+	m_arena.Carve( m_attachParent, m_maxParticles );
+	m_arena.Carve( m_constraints, m_numConstraints );
+	m_arena.Carve( m_lambda, m_numConstraints );
+	m_arena.Carve( m_batches, m_numBatches );
+	m_arena.Carve( m_triangles, m_numTriangles * 3 );
+
+	m_arena.Carve( m_vertexTriangleStart, m_maxParticles + 1 );
+	m_arena.Carve( m_vertexTriangles, m_numTriangles * 3 );
+	m_arena.Carve( m_vertexConstraintStart, m_maxParticles + 1 );
+	m_arena.Carve( m_vertexConstraints, m_numConstraints * 2 );
+	m_arena.Carve( m_adjacencyRoot, m_maxParticles );
+
+	m_arena.Carve( m_tiles, m_maxTiles );
+	m_arena.Carve( m_tileMin, m_maxTiles );
+	m_arena.Carve( m_tileMax, m_maxTiles );
+	m_arena.Carve( m_tileActive, m_maxTiles );
+	m_arena.Carve( m_tileTests, m_maxTiles );
+	m_arena.Carve( m_tileStamp, m_maxTiles );
+
+	m_restPos			= NULL;
+	m_restTexCoords		= NULL;
+	m_restConstraints	= NULL;
+	m_restBatches		= NULL;
+	m_restTriangles		= NULL;
+	if( !IsGrid() )
+	{
+		m_arena.Carve( m_restPos, m_numRestParticles );
+		m_arena.Carve( m_restTexCoords, m_numRestParticles );
+		m_arena.Carve( m_restConstraints, m_numRestConstraints );
+		m_arena.Carve( m_restBatches, m_numRestBatches );
+		m_arena.Carve( m_restTriangles, m_numTriangles * 3 );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: CountTiles()
+// Desc: Returns how many tiles of the given size the cloth needs: the grid
+//		 tiles, then runs of the particles past the grid
+//------------------------------------------------------------------------------
+int ParticleSystem::CountTiles( const int tileDim ) const
+{
+	const int tilesPerDim	= ( m_prtsPerDim + tileDim - 1 ) / tileDim;
+	const int tileSize		= tileDim * tileDim;
+	const int numGrid		= m_prtsPerDim * m_prtsPerDim;
+
+	return ( tilesPerDim * tilesPerDim ) +
+		   ( ( m_maxParticles - numGrid + tileSize - 1 ) / tileSize );
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildTiles()
+// Desc: Splits the particles into tiles for collision culling. A grid is cut
+//		 into m_tileDim square blocks; mesh particles, and any split off by
+//		 tearing, are already in spatial order so they take runs of as many.
+//------------------------------------------------------------------------------
+void ParticleSystem::BuildTiles()
+{
+	const int tilesPerDim	= ( m_prtsPerDim + m_tileDim - 1 ) / m_tileDim;
+	const int tileSize		= m_tileDim * m_tileDim;
+	const int numGrid		= m_prtsPerDim * m_prtsPerDim;
+	const int numRuns		= m_numTiles - ( tilesPerDim * tilesPerDim );
+
+	memset( m_tileActive, 0, m_maxTiles * sizeof( bool ) );
+	memset( m_tileTests, 0, m_maxTiles * sizeof( int ) );
+	memset( &m_collisionStats, 0, sizeof( m_collisionStats ) );
+
+	int tile = 0;
+	for( int row = 0; row < m_prtsPerDim; row += m_tileDim )
+	{
+		for( int column = 0; column < m_prtsPerDim; column += m_tileDim )
+		{
+			ClothTile& t	= m_tiles[ tile++ ];
+			t.first			= ( row * m_prtsPerDim ) + column;
+			t.rows			= std::min( m_tileDim, m_prtsPerDim - row );
+			t.columns		= std::min( m_tileDim, m_prtsPerDim - column );
+			t.stride		= m_prtsPerDim;
+		}
+	}
+
+	//runs are sized to the live particles in UpdateTileBounds()
+	for( int run = 0; run < numRuns; ++run )
+	{
+		ClothTile& t	= m_tiles[ tile++ ];
+		t.first			= numGrid + ( run * tileSize );
+		t.rows			= 1;
+		t.columns		= 0;
+		t.stride		= 0;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: GetParticleTile()
+// Desc: Returns the tile that holds a particle
+//------------------------------------------------------------------------------
+int ParticleSystem::GetParticleTile( const int particle ) const
+{
+	const int tilesPerDim	= ( m_prtsPerDim + m_tileDim - 1 ) / m_tileDim;
+	const int numGrid		= m_prtsPerDim * m_prtsPerDim;
+
+	if( particle < numGrid )
+	{
+		const int row		= particle / m_prtsPerDim;
+		const int column	= particle - ( row * m_prtsPerDim );
+		return ( ( row / m_tileDim ) * tilesPerDim ) + ( column / m_tileDim );
+	}
+
+	return ( tilesPerDim * tilesPerDim ) + ( ( particle - numGrid ) / ( m_tileDim * m_tileDim ) );
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildAdjacency()
+// Desc: Lists the triangles around each particle, in triangle order so that
+//		 gathered normals sum exactly as the old scattered ones did, then the
+//		 tiles each tile shares triangles with. Rebuilt when the cloth is
+//		 mended; tearing patches the lists in place instead.
+//------------------------------------------------------------------------------
+void ParticleSystem::BuildAdjacency()
+{
+	//count the triangles at each particle, then sort them into place using
+	//the starts as cursors and move the starts back
+	memset( m_vertexTriangleStart, 0, sizeof( int ) * ( m_numParticles + 1 ) );
+	for( int i = 0; i < m_numTriangles * 3; ++i )
+		++m_vertexTriangleStart[ m_triangles[ i ] + 1 ];
+	for( int particle = 0; particle < m_numParticles; ++particle )
+		m_vertexTriangleStart[ particle + 1 ] += m_vertexTriangleStart[ particle ];
+
+	for( int i = 0; i < m_numTriangles * 3; ++i )
+		m_vertexTriangles[ m_vertexTriangleStart[ m_triangles[ i ] ]++ ] = i / 3;
+	for( int particle = m_numParticles; particle > 0; --particle )
+		m_vertexTriangleStart[ particle ] = m_vertexTriangleStart[ particle - 1 ];
+	m_vertexTriangleStart[ 0 ] = 0;
+
+	//every particle has lists of its own again
+	for( int particle = 0; particle < m_numParticles; ++particle )
+		m_adjacencyRoot[ particle ] = particle;
+
+	BuildTileNeighbours();
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildTileNeighbours()
+// Desc: Lists the tiles reached through each tile's triangles, without
+//		 allocating once the lists have grown. Tears leave the lists to be
+//		 brought up to date when they stop, as a tearing step's vertices wait
+//		 for the whole cloth anyway.
+//------------------------------------------------------------------------------
+void ParticleSystem::BuildTileNeighbours()
+{
+	SizeRunTiles();
+
+	int* const stamp = m_tileStamp;
+	for( int tile = 0; tile < m_numTiles; ++tile )
+		stamp[ tile ] = -1;
+	m_tileNeighbourStart.resize( m_numTiles + 1 );
+	m_tileNeighbours.clear();
+
+	for( int tile = 0; tile < m_numTiles; ++tile )
+	{
+		m_tileNeighbourStart[ tile ] = int( m_tileNeighbours.size() );
+		stamp[ tile ] = tile;
+		m_tileNeighbours.push_back( tile );
+
+		const ClothTile& t = m_tiles[ tile ];
+		for( int row = 0; row < t.rows; ++row )
+		{
+			const int first = t.first + ( row * t.stride );
+			for( int particle = first; particle < first + t.columns; ++particle )
+			{
+				const int root = m_adjacencyRoot[ particle ];
+				for( int i = m_vertexTriangleStart[ root ];
+					 i < m_vertexTriangleStart[ root + 1 ]; ++i )
+				{
+					const int* pTriangle = &m_triangles[ m_vertexTriangles[ i ] * 3 ];
+					if( pTriangle[ 0 ] != particle && pTriangle[ 1 ] != particle &&
+						pTriangle[ 2 ] != particle )
+						continue;	//another's, on a list split from
+
+					for( int corner = 0; corner < 3; ++corner )
+					{
+						const int neighbour = GetParticleTile( pTriangle[ corner ] );
+						if( stamp[ neighbour ] != tile )
+						{
+							stamp[ neighbour ] = tile;
+							m_tileNeighbours.push_back( neighbour );
+						}
+					}
+				}
+			}
+		}
+	}
+	m_tileNeighbourStart[ m_numTiles ] = int( m_tileNeighbours.size() );
+	m_tileNeighboursStale = false;
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildConstraintAdjacency()
+// Desc: Lists the constraint slots at each particle, so that tearing finds
+//		 what to move without searching every constraint. Rebuilt whenever
+//		 the constraints are, and kept pointing at the right slots as tears
+//		 remove them.
+//------------------------------------------------------------------------------
+void ParticleSystem::BuildConstraintAdjacency()
+{
+	//count the constraints at each particle
+	memset( m_vertexConstraintStart, 0, sizeof( int ) * ( m_numParticles + 1 ) );
+	for( int batch = 0; batch < m_numBatches; ++batch )
+	{
+		const ConstraintBatch& b = m_batches[ batch ];
+		for( int i = b.first; i < b.first + b.count; ++i )
+		{
+			++m_vertexConstraintStart[ m_constraints[ i ].particleA + 1 ];
+			++m_vertexConstraintStart[ m_constraints[ i ].particleB + 1 ];
+		}
+	}
+	for( int particle = 0; particle < m_numParticles; ++particle )
+		m_vertexConstraintStart[ particle + 1 ] += m_vertexConstraintStart[ particle ];
+
+	//sort them into place as BuildAdjacency() does
+	for( int batch = 0; batch < m_numBatches; ++batch )
+	{
+		const ConstraintBatch& b = m_batches[ batch ];
+		for( int i = b.first; i < b.first + b.count; ++i )
+		{
+			m_vertexConstraints[ m_vertexConstraintStart[ m_constraints[ i ].particleA ]++ ] = i;
+			m_vertexConstraints[ m_vertexConstraintStart[ m_constraints[ i ].particleB ]++ ] = i;
+		}
+	}
+	for( int particle = m_numParticles; particle > 0; --particle )
+		m_vertexConstraintStart[ particle ] = m_vertexConstraintStart[ particle - 1 ];
+	m_vertexConstraintStart[ 0 ] = 0;
+}
+
 //------------------------------------------------------------------------------
 // Name: ~ParticleSystem()
 // Desc: Destructor for the cloth particle system
 //------------------------------------------------------------------------------
 ParticleSystem::~ParticleSystem()
 {
+	//the arena frees the arrays
+}
+
+//------------------------------------------------------------------------------
+// Name: SetNumIterations()
+// Desc: Sets the solver iteration count and picks the matching kernel
+//------------------------------------------------------------------------------
+void ParticleSystem::SetNumIterations( const int numIterations )
+{
+	m_numIterations = numIterations;
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetNumSubsteps()
+// Desc: Sets how many times each time step integrates and relaxes the cloth.
+//		 The old positions are rescaled so the particles keep their speed.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetNumSubsteps( const int numSubsteps )
+{
+	const float scale = float( m_numSubsteps ) / float( numSubsteps );
+	for( int i = 0; i < m_numParticles; ++i )
+	{
+		const D3DXVECTOR3 vOld = GetOldPosition( i );
+		SetOldPosition( i, m_pos[ i ] - ( m_pos[ i ] - vOld ) * scale );
+	}
+
+	m_numSubsteps = numSubsteps;
+}
+
+//------------------------------------------------------------------------------
+// Name: SetSolver()
+// Desc: Picks the constraint solver. Only projection has grid kernels.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetSolver( const ConstraintSolver solver )
+{
+	m_solver = solver;
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetCompliance()
+// Desc: Sets the XPBD compliance of one type of constraint
+//------------------------------------------------------------------------------
+void ParticleSystem::SetCompliance( const ConstraintType type, const float compliance )
+{
+	m_compliance[ type ] = compliance;
+}
+
+//------------------------------------------------------------------------------
+// Name: SetOverRelaxation()
+// Desc: Sets the factor on each projection correction. The grid kernels only
+//		 do plain projection.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetOverRelaxation( const float factor )
+{
+	m_overRelaxation = factor;
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetChebyshev()
+// Desc: Turns Chebyshev extrapolation across projection sweeps on or off
+//------------------------------------------------------------------------------
+void ParticleSystem::SetChebyshev( const bool enable )
+{
+	m_chebyshev = enable;
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: IsAccelerated()
+// Desc: Is the projection solver over-relaxed or extrapolated?
+//------------------------------------------------------------------------------
+bool ParticleSystem::IsAccelerated() const
+{
+	return m_solver == SOLVER_JAKOBSEN && ( m_chebyshev || m_overRelaxation != 1.0f );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetTearing()
+// Desc: Turns tearing on or off. Constraints tear once they are stretched by
+//		 more than tearStrain times their rest length.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetTearing( const bool enable, const float tearStrain )
+{
+	m_tearing		= enable;
+	m_tearStrain	= tearStrain;
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetAnchor()
+// Desc: Pins a particle at its current position, or frees it
+//------------------------------------------------------------------------------
+void ParticleSystem::SetAnchor( const int particle, const bool anchored )
+{
+	if( particle < 0 || particle >= m_numParticles )
+		return;
+
+	const std::vector< int >::iterator it =
+		std::find( m_anchors.begin(), m_anchors.end(), particle );
+	if( anchored && it == m_anchors.end() )
+	{
+		m_anchors.push_back( particle );
+		m_anchorPositions.push_back( m_pos[ particle ] );
+	}
+	else if( !anchored && it != m_anchors.end() )
+	{
+		m_anchorPositions.erase( m_anchorPositions.begin() + ( it - m_anchors.begin() ) );
+		m_anchors.erase( it );
+	}
+
+	BuildAttachments();
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: ClearAnchors()
+// Desc: Frees every pinned particle
+//------------------------------------------------------------------------------
+void ParticleSystem::ClearAnchors()
+{
+	m_anchors.clear();
+	m_anchorPositions.clear();
+
+	BuildAttachments();
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetAttachments()
+// Desc: Turns the long-range attachments on or off, and sets how far past
+//		 its rest distance from its anchor a particle may stretch, as a share
+//		 of that distance. With them off the anchors are still pinned.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetAttachments( const bool enable, const float stretch )
+{
+	m_attachments	= enable;
+	m_attachStretch	= std::max( stretch, 0.0f );
+
+	BuildAttachments();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetTileDim()
+// Desc: Recuts the cloth into tiles of another size. Smaller tiles cull the
+//		 collider more tightly and make more, smaller jobs.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetTileDim( const int tileDim )
+{
+	m_tileDim	= std::max( int( MIN_TILE_DIM ), std::min( tileDim, int( MAX_TILE_DIM ) ) );
+	m_numTiles	= CountTiles( m_tileDim );
+
+	BuildTiles();
+	BuildTileNeighbours();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetSpecialisation()
+// Desc: Allows or rules out the specialised grid kernels, which are not
+//		 faster on every processor
+//------------------------------------------------------------------------------
+void ParticleSystem::SetSpecialisation( const bool enable )
+{
+	m_specialisation = enable;
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: SetDeterministic()
+// Desc: Makes every step give the same bits on any number of threads. The
+//		 step graph is already ordered the same way whatever runs it - the
+//		 chunks of a batch touch different particles and their residuals are
+//		 added up in chunk order - so what is left is the floating-point mode
+//		 of the workers and the choice of kernel.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetDeterministic( const bool enable )
+{
+	m_deterministic = enable;
+	m_stepGraph.SetInheritFloatingPoint( enable );
+	SelectKernel();
+}
+
+//------------------------------------------------------------------------------
+// Name: GetChecksum()
+// Desc: FNV-1a hash of the live particles' positions, a word at a time. Equal
+//		 checksums from two runs mean, to all intents, bit-identical cloths.
+//------------------------------------------------------------------------------
+DWORD ParticleSystem::GetChecksum() const
+{
+	const DWORD FNV_OFFSET	= 2166136261u;
+	const DWORD FNV_PRIME	= 16777619u;
+
+	DWORD hash = ( FNV_OFFSET ^ DWORD( m_numParticles ) ) * FNV_PRIME;
+
+	const DWORD* pWords = (const DWORD*)m_pos;
+	const int numWords = m_numParticles * ( sizeof( D3DXVECTOR3 ) / sizeof( DWORD ) );
+	for( int i = 0; i < numWords; ++i )
+		hash = ( hash ^ pWords[ i ] ) * FNV_PRIME;
+
+	return hash;
+}
+
+//------------------------------------------------------------------------------
+// Name: SetSphere()
+// Desc: Moves and resizes the collider. The tiles are culled against it
+//		 afresh on every collision pass, so nothing else needs to know.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetSphere( const D3DXVECTOR3& vPosition, const float radius )
+{
+	m_spherePosition	= vPosition;
+	m_sphereRadius		= radius;
+}
+
+//------------------------------------------------------------------------------
+// Name: SelectKernel()
+// Desc: Picks the specialised kernel for an intact, unpinned grid that
+//		 cannot tear
+//------------------------------------------------------------------------------
+void ParticleSystem::SelectKernel()
+{
+	if( m_specialisation && !m_deterministic && IsGrid() && !m_tearing && !m_torn &&
+		m_solver == SOLVER_JAKOBSEN && !IsAccelerated() && m_anchors.empty() )
+		m_pKernel = FindGridKernel( m_prtsPerDim, m_numIterations );
+	else
+		m_pKernel = NULL;
 }
 
 //------------------------------------------------------------------------------
@@ -49,18 +716,61 @@ ParticleSystem::~ParticleSystem()
 //------------------------------------------------------------------------------
 void ParticleSystem::Initialise()
 {
+	//drop any particles split off by tearing
+	m_numParticles		= m_numRestParticles;
+	m_numPendingTears	= 0;
+	m_numTears			= 0;
+
+	//a mesh cloth just goes back to its rest shape
+	if( !IsGrid() )
+	{
+		for( int i = 0; i < m_numParticles; ++i )
+		{
+			m_pos[ i ]			= m_restPos[ i ];
+			SetOldPosition( i, m_restPos[ i ] );
+			m_acc[ i ]			= D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
+			m_texCoords[ i ]	= m_restTexCoords[ i ];
+		}
+
+		m_constraintPosition = m_restPos[ m_constraintParticle ];
+
+		//mend any tears
+		m_numConstraints	= m_numRestConstraints;
+		m_numBatches		= m_numRestBatches;
+		memcpy( m_constraints, m_restConstraints,
+				m_numConstraints * sizeof( ClothConstraint ) );
+		memcpy( m_batches, m_restBatches, m_numBatches * sizeof( ConstraintBatch ) );
+
+		if( m_torn )
+		{
+			memcpy( m_triangles, m_restTriangles, m_numTriangles * 3 * sizeof( int ) );
+			BuildAdjacency();
+			m_indices = m_restIndices;
+			m_torn = false;
+			SelectKernel();
+		}
+
+		BuildConstraintAdjacency();
+		PlaceAnchors();
+		UpdateTileBounds();
+		return;
+	}
+
 	//calculate the distance between particles
 	const float SURFACE_SIZE = 1.0f;
-	const float PARTICLE_SPACE = SURFACE_SIZE / ( PRTS_PER_DIM - 1 );
+	const float PARTICLE_SPACE = SURFACE_SIZE / ( m_prtsPerDim - 1 );
+	m_particleSpace = PARTICLE_SPACE;
+	m_maxRestLength = PARTICLE_SPACE * 2.0f;	//the bend length
+	m_quantStep = m_maxRestLength / MAX_QUANTISED;
 
 	//work out which will be the center particle in the cloth
-	m_constraintParticle = ( PRTS_PER_DIM / 2 ) * PRTS_PER_DIM;	//row
-	m_constraintParticle += ( ( PRTS_PER_DIM - 1 ) / 2 );	//column
+	m_constraintParticle = ( m_prtsPerDim / 2 ) * m_prtsPerDim;	//row
+	m_constraintParticle += ( ( m_prtsPerDim - 1 ) / 2 );	//column
 
 	//initialise particles in a grid pattern...
-	for( int row = 0; row < PRTS_PER_DIM; ++row )
+	for( int row = 0; row < m_prtsPerDim; ++row )
 	{
-		for( int column = 0; column < PRTS_PER_DIM; ++column )
+		for( int column = 0; column < m_prtsPerDim; ++column )
 		{
 			//calculate this particle's position
 			D3DXVECTOR3 vParticlePosition = D3DXVECTOR3( PARTICLE_SPACE * column,
@@ -72,10 +782,12 @@ void ParticleSystem::Initialise()
 			vParticlePosition[ 2 ] -= 0.5f;
 
 			//set particle variables
-			int index			= ( row * PRTS_PER_DIM ) + column;
+			int index			= ( row * m_prtsPerDim ) + column;
 			m_pos[ index ]		= vParticlePosition;
-			m_oldPos[ index ]	= vParticlePosition;
+			SetOldPosition( index, vParticlePosition );
 			m_acc[ index ]		= D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
+			m_texCoords[ index ]= D3DXVECTOR2( column / float( m_prtsPerDim - 1 ),
+											   row / float( m_prtsPerDim - 1 ) );
 
 			//set the constraint point if needed
 			if( m_constraintParticle == index )
@@ -88,31 +800,33 @@ void ParticleSystem::Initialise()
 
 	//first set: one step in lateral directions - preserves size
 	//rows
-	for( int row = 0; row < PRTS_PER_DIM; ++row )
-	{
-		for( int column = 0; column < ( PRTS_PER_DIM - 1 ); ++column )
+	for( int row = 0; row < m_prtsPerDim; ++row )
+	{
+		for( int column = 0; column < ( m_prtsPerDim - 1 ); ++column )
 		{
-			int particleNumber = ( row * PRTS_PER_DIM ) + column;
+			int particleNumber = ( row * m_prtsPerDim ) + column;
 
 			ClothConstraint c;
 			c.particleA		= particleNumber;
 			c.particleB		= particleNumber + 1;
 			c.restLength	= PARTICLE_SPACE;
+			c.type			= CONSTRAINT_STRUCTURAL;
 			m_constraints[ constraintIndex++ ] = c;
 		}
 	}
 
 	//columns
-	for( int row = 0; row < ( PRTS_PER_DIM - 1 ); ++row )
-	{
-		for( int column = 0; column < PRTS_PER_DIM; ++column )		
+	for( int row = 0; row < ( m_prtsPerDim - 1 ); ++row )
+	{
+		for( int column = 0; column < m_prtsPerDim; ++column )		
 		{
-			int particleNumber = ( row * PRTS_PER_DIM ) + column;
+			int particleNumber = ( row * m_prtsPerDim ) + column;
 
 			ClothConstraint c;
 			c.particleA		= particleNumber;
-			c.particleB		= particleNumber + PRTS_PER_DIM;
+			c.particleB		= particleNumber + m_prtsPerDim;
 			c.restLength	= PARTICLE_SPACE;
+			c.type			= CONSTRAINT_STRUCTURAL;
 			m_constraints[ constraintIndex++ ] = c;
 		}
 	}
@@ -120,175 +834,778 @@ void ParticleSystem::Initialise()
 	//second set: one step in one diagonal direction - prevents shearing
 	const float diagonalLength = float( sqrt( PARTICLE_SPACE * PARTICLE_SPACE +
 											  PARTICLE_SPACE * PARTICLE_SPACE ) );
+	m_diagonalSpace = diagonalLength;
 
 	//first diagonal direction - matches with triangulation
-	for( int row = 0; row < ( PRTS_PER_DIM - 1 ); ++row )
-	{
-		for( int column = 1; column < PRTS_PER_DIM; ++column )		
+	for( int row = 0; row < ( m_prtsPerDim - 1 ); ++row )
+	{
+		for( int column = 1; column < m_prtsPerDim; ++column )		
 		{
-			int particleNumber = ( row * PRTS_PER_DIM ) + column;
+			int particleNumber = ( row * m_prtsPerDim ) + column;
 
 			ClothConstraint c;
 			c.particleA		= particleNumber;
-			c.particleB		= ( particleNumber + PRTS_PER_DIM ) - 1;
+			c.particleB		= ( particleNumber + m_prtsPerDim ) - 1;
 			c.restLength	= diagonalLength;
+			c.type			= CONSTRAINT_SHEAR;
 			m_constraints[ constraintIndex++ ] = c;
 		}
 	}
 
 	//first set: two steps in lateral directions - preserves stiffness
 	//rows
-	for( int row = 0; row < PRTS_PER_DIM; ++row )
-	{
-		for( int column = 0; column < ( PRTS_PER_DIM - 2 ); ++column )
+	for( int row = 0; row < m_prtsPerDim; ++row )
+	{
+		for( int column = 0; column < ( m_prtsPerDim - 2 ); ++column )
 		{
-			int particleNumber = ( row * PRTS_PER_DIM ) + column;
+			int particleNumber = ( row * m_prtsPerDim ) + column;
 
 			ClothConstraint c;
 			c.particleA		= particleNumber;
 			c.particleB		= particleNumber + 2;
 			c.restLength	= PARTICLE_SPACE * 2.0f;
+			c.type			= CONSTRAINT_BEND;
 			m_constraints[ constraintIndex++ ] = c;
 		}
 	}
 
 	//columns
-	for( int row = 0; row < ( PRTS_PER_DIM - 2 ); ++row )
-	{
-		for( int column = 0; column < PRTS_PER_DIM; ++column )			
+	for( int row = 0; row < ( m_prtsPerDim - 2 ); ++row )
+	{
+		for( int column = 0; column < m_prtsPerDim; ++column )			
 		{
-			int particleNumber = ( row * PRTS_PER_DIM ) + column;
+			int particleNumber = ( row * m_prtsPerDim ) + column;
 
 			ClothConstraint c;
 			c.particleA		= particleNumber;
-			c.particleB		= particleNumber + PRTS_PER_DIM + PRTS_PER_DIM;
+			c.particleB		= particleNumber + m_prtsPerDim + m_prtsPerDim;
 			c.restLength	= PARTICLE_SPACE * 2.0f;
+			c.type			= CONSTRAINT_BEND;
 			m_constraints[ constraintIndex++ ] = c;
 		}
 	}
-}
 
-//------------------------------------------------------------------------------
-// Name: FillVertexBuffer()
-// Desc: Fills the vertex buffer with the vertices formed by the particles
-//------------------------------------------------------------------------------
-HRESULT ParticleSystem::FillVertexBuffer( const LPDIRECT3DVERTEXBUFFER9 pVB ) const
-{
-	//lock the buffer
-	CLOTH_VERTEX* pBuffer = NULL;
-    if( FAILED( pVB->Lock( 0, NUM_PARTICLES * sizeof( CLOTH_VERTEX ),
-						   (void**)&pBuffer, 0 ) ) )
-		return( E_FAIL );
-
-	//calculate the texture coord spacing for the vertices
-	const float TEXTURE_SIZE = 1.0f;
-	const float TEXTURE_SPACE = TEXTURE_SIZE / ( PRTS_PER_DIM - 1 );
-
-	//build and copy the vertices...
-	for( int row = 0; row < PRTS_PER_DIM; ++row )
-	{
-		for( int column = 0; column < PRTS_PER_DIM; ++column )
-		{
-			int particle = column + ( row * PRTS_PER_DIM );
-
-			//calculate vertex normal...
-			D3DXVECTOR3 vertexNormal = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
-
-			//upper left face...
-			if( column != 0 && row != 0 )
-				vertexNormal += GetFaceNormal( m_pos[ particle ],
-											   m_pos[ particle - PRTS_PER_DIM ],
-											   m_pos[ particle - 1 ] );
-
-			//upper right face...
-			if( column != ( PRTS_PER_DIM - 1 ) && row != 0 )
-				vertexNormal += GetFaceNormal( m_pos[ particle ],
-											   m_pos[ particle + 1 ],
-											   m_pos[ particle - PRTS_PER_DIM ] );
-
-			//lower left face...
-			if( column != 0 && row != ( PRTS_PER_DIM - 1 ) )
-				vertexNormal += GetFaceNormal( m_pos[ particle ],
-											   m_pos[ particle - 1 ],
-											   m_pos[ particle + PRTS_PER_DIM ] );
-											   
-
-			//lower right face...
-			if( column != ( PRTS_PER_DIM - 1 ) && row != ( PRTS_PER_DIM - 1 ) )
-				vertexNormal += GetFaceNormal( m_pos[ particle ],
-											   m_pos[ particle + PRTS_PER_DIM ],
-											   m_pos[ particle + 1 ] );
-
-			//normalize result
-			D3DXVec3Normalize( &vertexNormal, &vertexNormal );
-
-			CLOTH_VERTEX v;
-			v.p = m_pos[ particle ];
-			v.n = vertexNormal;
-			v.tu = TEXTURE_SPACE * column;
-			v.tv = TEXTURE_SPACE * row;
-
-			pBuffer[ particle ] = v;
-		}
-	}
-
-	//unlock the buffer
-	pVB->Unlock();
-
-	return S_OK;
+	//the grid solves its constraints in one run, in the order above
+	m_numConstraints		= constraintIndex;
+	m_numBatches			= 1;
+	m_batches[ 0 ].first	= 0;
+	m_batches[ 0 ].count	= m_numConstraints;
+
+	//mend any tears
+	if( m_torn )
+	{
+		BuildGridTriangles();
+		BuildAdjacency();
+		m_indices = m_restIndices;
+		m_torn = false;
+		SelectKernel();
+	}
+
+	BuildConstraintAdjacency();
+	PlaceAnchors();
+	UpdateTileBounds();
 }
 
 //------------------------------------------------------------------------------
-// Name: FillIndexBuffer()
-// Desc: Fills the index buffer with values to render a triangle list
+// Name: PlaceAnchors()
+// Desc: Pins the anchors at their particles' rest positions, dropping any
+//		 on particles that tearing had split off, and measures the
+//		 attachments again
 //------------------------------------------------------------------------------
-HRESULT ParticleSystem::FillIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB ) const
+void ParticleSystem::PlaceAnchors()
 {
-	//lock the buffer
-	int* pBuffer = NULL;
-	const static int NUM_INDICES = ( ParticleSystem::PRTS_PER_DIM - 1 ) *
-								   ( ParticleSystem::PRTS_PER_DIM - 1 ) * 6;
-
-	if( FAILED( pIB->Lock( 0, NUM_INDICES * sizeof( WORD ), (void**)&pBuffer, 0 ) ) )
-		return( E_FAIL );
-
-	int currentIndex = 0;
-
-	for( int row = 0; row < ( PRTS_PER_DIM - 1 ); ++row )
-	{
-		for( int column = 0; column < ( PRTS_PER_DIM - 1 ); ++column )
+	for( size_t i = m_anchors.size(); i-- > 0; )
+	{
+		if( m_anchors[ i ] >= m_numParticles )
 		{
-			//this is per-square - fill out 6 indices = 3 triangles...
-			//calculate the start of the square's indices
-			int firstIndex = ( row * PRTS_PER_DIM ) + column;
-
-			//triangle 1
-			pBuffer[ currentIndex++ ] = firstIndex;
-			pBuffer[ currentIndex++ ] = firstIndex + 1;
-			pBuffer[ currentIndex++ ] = firstIndex + PRTS_PER_DIM;
-
-			//triangle 2
-			pBuffer[ currentIndex++ ] = firstIndex + PRTS_PER_DIM;
-			pBuffer[ currentIndex++ ] = firstIndex + 1;
-			pBuffer[ currentIndex++ ] = firstIndex + PRTS_PER_DIM + 1;
+			m_anchors.erase( m_anchors.begin() + i );
+			m_anchorPositions.erase( m_anchorPositions.begin() + i );
 		}
+		else
+			m_anchorPositions[ i ] = m_pos[ m_anchors[ i ] ];
 	}
 
+	BuildAttachments();
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildAttachments()
+// Desc: Finds each particle's nearest anchor and its distance from it across
+//		 the cloth at rest, by Dijkstra's algorithm from every anchor at once
+//		 over the structural and shear constraints. Bend constraints cut
+//		 across folds, so they are left out. Particles no anchor reaches, as
+//		 on a piece torn free, keep the first anchor at FLT_MAX, which
+//		 Attach() never pulls back. Each particle keeps the one before it on
+//		 its path, so that tears need only search again behind where they cut.
+//------------------------------------------------------------------------------
+void ParticleSystem::BuildAttachments()
+{
+	for( int i = 0; i < m_numParticles; ++i )
+	{
+		m_attachAnchor[ i ]		= 0;
+		m_attachLength[ i ]		= FLT_MAX;
+		m_attachDistance[ i ]	= FLT_MAX;
+		m_attachParent[ i ]		= -1;
+	}
+
+	//each anchor is attached to itself, which is what pins it
+	for( size_t anchor = 0; anchor < m_anchors.size(); ++anchor )
+	{
+		m_attachAnchor[ m_anchors[ anchor ] ]	= int( anchor );
+		m_attachLength[ m_anchors[ anchor ] ]	= 0.0f;
+		m_attachDistance[ m_anchors[ anchor ] ]	= 0.0f;
+	}
+	if( !m_attachments || m_anchors.empty() )
+		return;
+
+	//nearest first, from every anchor at once
+	typedef std::pair< float, int > Reached;
+	std::greater< Reached > nearer;
+	std::vector< Reached >& open = m_attachOpen;
+	open.clear();
+	for( size_t anchor = 0; anchor < m_anchors.size(); ++anchor )
+	{
+		open.push_back( Reached( 0.0f, m_anchors[ anchor ] ) );
+		std::push_heap( open.begin(), open.end(), nearer );
+	}
+
+	SearchAttachments();
+}
+
+//------------------------------------------------------------------------------
+// Name: SearchAttachments()
+// Desc: Carries the search on from the particles in its heap to all those it
+//		 can reach more closely than they are. The edges are the constraint
+//		 lists, and the heap keeps its capacity, so this allocates nothing
+//		 once it has run.
+//------------------------------------------------------------------------------
+void ParticleSystem::SearchAttachments()
+{
+	typedef std::pair< float, int > Reached;
+	std::greater< Reached > nearer;
+	std::vector< Reached >& open = m_attachOpen;
+
+	//give the cloth a little slack over the rest distances
+	const float scale = 1.0f + m_attachStretch;
+
+	while( !open.empty() )
+	{
+		const Reached reached = open.front();
+		std::pop_heap( open.begin(), open.end(), nearer );
+		open.pop_back();
+
+		const int particle = reached.second;
+		if( reached.first > m_attachDistance[ particle ] )
+			continue;	//already reached by a shorter way
+
+		const int root = m_adjacencyRoot[ particle ];
+		for( int i = m_vertexConstraintStart[ root ];
+			 i < m_vertexConstraintStart[ root + 1 ]; ++i )
+		{
+			if( m_vertexConstraints[ i ] < 0 )
+				continue;	//torn
+
+			const ClothConstraint& c = m_constraints[ m_vertexConstraints[ i ] ];
+			if( c.type == CONSTRAINT_BEND ||
+				( c.particleA != particle && c.particleB != particle ) )
+				continue;
+
+			const int other = ( c.particleA == particle ) ? c.particleB : c.particleA;
+			const float distance = reached.first + c.restLength;
+			if( distance < m_attachDistance[ other ] )
+			{
+				m_attachDistance[ other ]	= distance;
+				m_attachLength[ other ]		= distance * scale;
+				m_attachAnchor[ other ]		= m_attachAnchor[ particle ];
+				m_attachParent[ other ]		= particle;
+				open.push_back( Reached( distance, other ) );
+				std::push_heap( open.begin(), open.end(), nearer );
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: DetachParticle()
+// Desc: Notes that a tear has cut a particle's path to its anchor, for
+//		 RepairAttachments() to search for it again
+//------------------------------------------------------------------------------
+void ParticleSystem::DetachParticle( const int particle )
+{
+	if( !m_attachments || m_anchors.empty() || m_attachAnchor[ particle ] < 0 )
+		return;
+
+	m_attachAnchor[ particle ]		= -1;	//until the search is over
+	m_attachLength[ particle ]		= FLT_MAX;
+	m_attachDistance[ particle ]	= FLT_MAX;
+	m_attachParent[ particle ]		= -1;
+	m_attachStale.push_back( particle );
+}
+
+//------------------------------------------------------------------------------
+// Name: RepairAttachments()
+// Desc: Searches again for the particles whose paths tears have cut, and
+//		 those whose paths ran through them. Tears only make paths longer, so
+//		 every other particle's path is still its shortest, and the search
+//		 starts from those next to the cut ones rather than from the anchors.
+//------------------------------------------------------------------------------
+void ParticleSystem::RepairAttachments()
+{
+	std::vector< int >& stale = m_attachStale;
+
+	//anything reached through a cut particle is cut too
+	for( size_t s = 0; s < stale.size(); ++s )
+	{
+		const int particle = stale[ s ];
+		const int root = m_adjacencyRoot[ particle ];
+		for( int i = m_vertexConstraintStart[ root ];
+			 i < m_vertexConstraintStart[ root + 1 ]; ++i )
+		{
+			if( m_vertexConstraints[ i ] < 0 )
+				continue;
+
+			const ClothConstraint& c = m_constraints[ m_vertexConstraints[ i ] ];
+			if( c.particleA == particle && m_attachParent[ c.particleB ] == particle )
+				DetachParticle( c.particleB );
+			else if( c.particleB == particle && m_attachParent[ c.particleA ] == particle )
+				DetachParticle( c.particleA );
+		}
+	}
+
+	//start from the uncut particles around them
+	typedef std::pair< float, int > Reached;
+	std::greater< Reached > nearer;
+	std::vector< Reached >& open = m_attachOpen;
+	open.clear();
+	for( size_t s = 0; s < stale.size(); ++s )
+	{
+		const int particle = stale[ s ];
+		const int root = m_adjacencyRoot[ particle ];
+		for( int i = m_vertexConstraintStart[ root ];
+			 i < m_vertexConstraintStart[ root + 1 ]; ++i )
+		{
+			if( m_vertexConstraints[ i ] < 0 )
+				continue;
+
+			const ClothConstraint& c = m_constraints[ m_vertexConstraints[ i ] ];
+			if( c.type == CONSTRAINT_BEND ||
+				( c.particleA != particle && c.particleB != particle ) )
+				continue;
+
+			const int other = ( c.particleA == particle ) ? c.particleB : c.particleA;
+			if( m_attachAnchor[ other ] >= 0 && m_attachDistance[ other ] < FLT_MAX )
+			{
+				open.push_back( Reached( m_attachDistance[ other ], other ) );
+				std::push_heap( open.begin(), open.end(), nearer );
+			}
+		}
+	}
+
+	//those the search does not reach keep the first anchor, as in
+	//BuildAttachments()
+	for( size_t s = 0; s < stale.size(); ++s )
+		m_attachAnchor[ stale[ s ] ] = 0;
+	stale.clear();
+
+	SearchAttachments();
+}
+
+//------------------------------------------------------------------------------
+// Name: SampleGrid()
+// Desc: Bilinearly interpolates a grid of vectors at a fractional row/column
+//------------------------------------------------------------------------------
+static D3DXVECTOR3 SampleGrid( const D3DXVECTOR3* pGrid, const int prtsPerDim,
+							   const float row, const float column )
+{
+	const int r = std::min( int( row ), prtsPerDim - 2 );
+	const int c = std::min( int( column ), prtsPerDim - 2 );
+	const float fr = row - r;
+	const float fc = column - c;
+
+	const D3DXVECTOR3* const pRow = pGrid + ( r * prtsPerDim ) + c;
+	const D3DXVECTOR3 vTop		= pRow[ 0 ] + ( pRow[ 1 ] - pRow[ 0 ] ) * fc;
+	const D3DXVECTOR3 vBottom	= pRow[ prtsPerDim ] +
+								  ( pRow[ prtsPerDim + 1 ] - pRow[ prtsPerDim ] ) * fc;
+	return vTop + ( vBottom - vTop ) * fr;
+}
+
+//------------------------------------------------------------------------------
+// Name: SampleOldGrid()
+// Desc: Interpolates a grid cloth's old positions as SampleGrid() does,
+//		 taking only the four around the sample out of whatever format the
+//		 cloth keeps them in
+//------------------------------------------------------------------------------
+static D3DXVECTOR3 SampleOldGrid( const ParticleSystem& source, const float row,
+								  const float column )
+{
+	const int prtsPerDim = source.GetPrtsPerDim();
+	const int r = std::min( int( row ), prtsPerDim - 2 );
+	const int c = std::min( int( column ), prtsPerDim - 2 );
+	const int corner = ( r * prtsPerDim ) + c;
+
+	const D3DXVECTOR3 vCorners[ 4 ] =
+	{
+		source.GetOldPosition( corner ),
+		source.GetOldPosition( corner + 1 ),
+		source.GetOldPosition( corner + prtsPerDim ),
+		source.GetOldPosition( corner + prtsPerDim + 1 )
+	};
+	return SampleGrid( vCorners, 2, row - r, column - c );
+}
+
+//------------------------------------------------------------------------------
+// Name: Resample()
+// Desc: Takes over the state of another resolution of the same grid cloth,
+//		 interpolating its current and old positions at each particle. This
+//		 restricts a finer grid or prolongs a coarser one; velocities carry
+//		 over with the old positions, and the constraints are this grid's own.
+//------------------------------------------------------------------------------
+void ParticleSystem::Resample( const ParticleSystem& source )
+{
+	if( !IsGrid() || !source.IsGrid() )
+		return;
+
+	//start from the untorn grid
+	Initialise();
+
+	const float scale = float( source.m_prtsPerDim - 1 ) / float( m_prtsPerDim - 1 );
+
+	for( int row = 0; row < m_prtsPerDim; ++row )
+	{
+		for( int column = 0; column < m_prtsPerDim; ++column )
+		{
+			const int index = ( row * m_prtsPerDim ) + column;
+			m_pos[ index ]		= SampleGrid( source.m_pos, source.m_prtsPerDim,
+											  row * scale, column * scale );
+			SetOldPosition( index, SampleOldGrid( source, row * scale, column * scale ) );
+		}
+	}
+
+	//the anchors stay where the source held the cloth
+	for( size_t i = 0; i < m_anchors.size(); ++i )
+		m_anchorPositions[ i ] = m_pos[ m_anchors[ i ] ];
+
+	UpdateTileBounds();
+}
+
+//------------------------------------------------------------------------------
+// Name: GetBounds()
+// Desc: Returns the box around the cloth, from the tile bounds as of the
+//		 step's last collision pass
+//------------------------------------------------------------------------------
+void ParticleSystem::GetBounds( D3DXVECTOR3& vMin, D3DXVECTOR3& vMax ) const
+{
+	vMin = m_pos[ 0 ];
+	vMax = m_pos[ 0 ];
+
+	for( int tile = 0; tile < m_numTiles; ++tile )
+	{
+		if( m_tiles[ tile ].columns == 0 )
+			continue;
+
+		D3DXVec3Minimize( &vMin, &vMin, &m_tileMin[ tile ] );
+		D3DXVec3Maximize( &vMax, &vMax, &m_tileMax[ tile ] );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: GetCurvature()
+// Desc: Returns how sharply the cloth folds at its tightest point - how far
+//		 the most compressed bending constraint is from its rest length, from
+//		 zero when flat to one when folded back on itself
+//------------------------------------------------------------------------------
+float ParticleSystem::GetCurvature() const
+{
+	float curvature = 0.0f;
+
+	for( int batch = 0; batch < m_numBatches; ++batch )
+	{
+		const ConstraintBatch& b = m_batches[ batch ];
+		for( int i = b.first; i < b.first + b.count; ++i )
+		{
+			const ClothConstraint& c = m_constraints[ i ];
+			if( c.type != CONSTRAINT_BEND )
+				continue;
+
+			D3DXVECTOR3 vDelta = m_pos[ c.particleB ] - m_pos[ c.particleA ];
+			const float fold = 1.0f - D3DXVec3Length( &vDelta ) / c.restLength;
+			curvature = std::max( curvature, fold );
+		}
+	}
+
+	return curvature;
+}
+
+//------------------------------------------------------------------------------
+// Name: FillVertexBuffer()
+// Desc: Fills the vertex buffer with the vertices formed by the particles
+//------------------------------------------------------------------------------
+HRESULT ParticleSystem::FillVertexBuffer( const LPDIRECT3DVERTEXBUFFER9 pVB ) const
+{
+	//lock the buffer
+	CLOTH_VERTEX* pBuffer = NULL;
+    if( FAILED( pVB->Lock( 0, m_numParticles * sizeof( CLOTH_VERTEX ),
+						   (void**)&pBuffer, 0 ) ) )
+		return( E_FAIL );
+
+	FillVertices( pBuffer );
+
 	//unlock the buffer
-	pIB->Unlock();
+	pVB->Unlock();
 
 	return S_OK;
 }
 
+//------------------------------------------------------------------------------
+// Name: FillVertices()
+// Desc: Builds the vertices formed by the particles into memory
+//------------------------------------------------------------------------------
+void ParticleSystem::FillVertices( CLOTH_VERTEX* pBuffer ) const
+{
+	//a mesh or torn grid builds its normals from the triangle list
+	if( !IsGrid() || m_torn )
+	{
+		FillMeshVertices( pBuffer );
+		return;
+	}
+
+	//use the specialised kernel if there is one for this grid
+	if( m_pKernel != NULL )
+	{
+		m_pKernel->pfnFillVertices( m_pos, pBuffer );
+		return;
+	}
+
+	//calculate the texture coord spacing for the vertices
+	const float TEXTURE_SIZE = 1.0f;
+	const float TEXTURE_SPACE = TEXTURE_SIZE / ( m_prtsPerDim - 1 );
+
+	//build and copy the vertices...
+	for( int row = 0; row < m_prtsPerDim; ++row )
+	{
+		for( int column = 0; column < m_prtsPerDim; ++column )
+		{
+			int particle = column + ( row * m_prtsPerDim );
+
+			CLOTH_VERTEX v;
+			v.p = m_pos[ particle ];
+			v.n = GetGridNormal( m_pos, row, column, m_prtsPerDim );
+			v.tu = TEXTURE_SPACE * column;
+			v.tv = TEXTURE_SPACE * row;
+
+			pBuffer[ particle ] = v;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: FillMeshVertices()
+// Desc: Builds the vertices of a mesh cloth, gathering the face normals of
+//		 the triangles around each particle
+//------------------------------------------------------------------------------
+void ParticleSystem::FillMeshVertices( CLOTH_VERTEX* pBuffer ) const
+{
+	for( int i = 0; i < m_numParticles; ++i )
+		FillVertex( i, pBuffer[ i ] );
+}
+
+//------------------------------------------------------------------------------
+// Name: FillTileVertices()
+// Desc: Fills in the vertices of one tile's particles
+//------------------------------------------------------------------------------
+void ParticleSystem::FillTileVertices( const int tile, CLOTH_VERTEX* pBuffer ) const
+{
+	const ClothTile& t = m_tiles[ tile ];
+
+	for( int row = 0; row < t.rows; ++row )
+	{
+		const int first = t.first + ( row * t.stride );
+		for( int particle = first; particle < first + t.columns; ++particle )
+			FillVertex( particle, pBuffer[ particle ] );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: FillVertex()
+// Desc: Builds the vertex for one particle. An intact grid takes its normal
+//		 from the grid neighbours, anything else from the triangles around it,
+//		 summed in triangle order.
+//------------------------------------------------------------------------------
+void ParticleSystem::FillVertex( const int particle, CLOTH_VERTEX& v ) const
+{
+	v.p = m_pos[ particle ];
+
+	if( IsGrid() && !m_torn )
+	{
+		const float TEXTURE_SPACE = 1.0f / ( m_prtsPerDim - 1 );
+		const int row		= particle / m_prtsPerDim;
+		const int column	= particle - ( row * m_prtsPerDim );
+
+		v.n = GetGridNormal( m_pos, row, column, m_prtsPerDim );
+		v.tu = TEXTURE_SPACE * column;
+		v.tv = TEXTURE_SPACE * row;
+		return;
+	}
+
+	D3DXVECTOR3 vNormal = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
+	const int root = m_adjacencyRoot[ particle ];
+	for( int i = m_vertexTriangleStart[ root ];
+		 i < m_vertexTriangleStart[ root + 1 ]; ++i )
+	{
+		const int* pTriangle = &m_triangles[ m_vertexTriangles[ i ] * 3 ];
+		if( pTriangle[ 0 ] != particle && pTriangle[ 1 ] != particle &&
+			pTriangle[ 2 ] != particle )
+			continue;	//another's, on a list split from
+
+		vNormal += GetFaceNormal( m_pos[ pTriangle[ 0 ] ], m_pos[ pTriangle[ 1 ] ],
+								  m_pos[ pTriangle[ 2 ] ] );
+	}
+
+	D3DXVec3Normalize( &v.n, &vNormal );
+	v.tu = m_texCoords[ particle ].x;
+	v.tv = m_texCoords[ particle ].y;
+}
+
+//------------------------------------------------------------------------------
+// Name: FillIndexBuffer()
+// Desc: Fills the index buffer with values to render a triangle list
+//------------------------------------------------------------------------------
+HRESULT ParticleSystem::FillIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB ) const
+{
+	return m_indices.FillIndexBuffer( pIB );
+}
+
+//------------------------------------------------------------------------------
+// Name: UpdateIndexBuffer()
+// Desc: Copies just the indices changed by tearing into the index buffer
+//------------------------------------------------------------------------------
+HRESULT ParticleSystem::UpdateIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB )
+{
+	return m_indices.UpdateIndexBuffer( pIB );
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildGridTriangles()
+// Desc: Fills the triangle list for a grid cloth
+//------------------------------------------------------------------------------
+void ParticleSystem::BuildGridTriangles()
+{
+	int* pBuffer = m_triangles;
+	int currentIndex = 0;
+
+	for( int row = 0; row < ( m_prtsPerDim - 1 ); ++row )
+	{
+		for( int column = 0; column < ( m_prtsPerDim - 1 ); ++column )
+		{
+			//this is per-square - fill out 6 indices = 3 triangles...
+			//calculate the start of the square's indices
+			int firstIndex = ( row * m_prtsPerDim ) + column;
+
+			//triangle 1
+			pBuffer[ currentIndex++ ] = firstIndex;
+			pBuffer[ currentIndex++ ] = firstIndex + 1;
+			pBuffer[ currentIndex++ ] = firstIndex + m_prtsPerDim;
+
+			//triangle 2
+			pBuffer[ currentIndex++ ] = firstIndex + m_prtsPerDim;
+			pBuffer[ currentIndex++ ] = firstIndex + 1;
+			pBuffer[ currentIndex++ ] = firstIndex + m_prtsPerDim + 1;
+		}
+	}
+}
+
 //------------------------------------------------------------------------------
 // Name: TimeStep()
-// Desc: Updates the cloth model by one timestep
+// Desc: Updates the cloth model by one timestep, in substeps
 //------------------------------------------------------------------------------
 void ParticleSystem::TimeStep()
 {
-	AccumulateForces();
-	Verlet();
-	SatisfyConstraints();
+	PrepareSolver();
+
+	for( int substep = 0; substep < m_numSubsteps; ++substep )
+	{
+		AccumulateForces();
+		Verlet();
+		SizeRunTiles();
+		BeginRelaxation();
+
+		//look for tears once the whole step has settled
+		SatisfyConstraints( m_tearing && substep == ( m_numSubsteps - 1 ) );
+		CommitIntegration( 0, m_numParticles );
+	}
+
+	CountCollisions();
+}
+
+//------------------------------------------------------------------------------
+// Name: PrepareSolver()
+// Desc: Works out each constraint type's compliance over the squared substep,
+//		 which is what XPBD weighs the multipliers by
+//------------------------------------------------------------------------------
+void ParticleSystem::PrepareSolver()
+{
+	const float substep = m_timeStep / m_numSubsteps;
+	for( int type = 0; type < NUM_CONSTRAINT_TYPES; ++type )
+		m_alphaTilde[ type ] = m_compliance[ type ] / ( substep * substep );
+}
+
+//------------------------------------------------------------------------------
+// Name: BeginRelaxation()
+// Desc: Starts a substep's XPBD multipliers at zero, and its acceleration
+//		 afresh
+//------------------------------------------------------------------------------
+void ParticleSystem::BeginRelaxation()
+{
+	if( m_solver == SOLVER_XPBD )
+		memset( m_lambda, 0, m_numRestConstraints * sizeof( float ) );
+
+	m_relaxScale		= IsAccelerated() ? 0.5f * m_overRelaxation : 0.5f;
+	m_accelerating		= true;
+	m_chebyshevOmega	= 1.0f;
+}
+
+//------------------------------------------------------------------------------
+// Name: EndSweep()
+// Desc: Records a relaxation sweep's residual, given as the sum of the
+//		 squared constraint errors it met, and works out how far to
+//		 extrapolate the positions it left. The plain sweeps before Chebyshev
+//		 starts show how fast the cloth converges; a residual that grows while
+//		 accelerated puts the rest of the substep back on plain sweeps.
+//------------------------------------------------------------------------------
+void ParticleSystem::EndSweep( const int iteration, const double residual )
+{
+	const float rms = float( sqrt( residual / std::max( m_numConstraints, 1 ) ) );
+
+	SolverStats& stats = m_solverStats;
+	if( iteration == 0 )
+	{
+		stats.numSweeps			= 0;
+		stats.firstResidual		= rms;
+		stats.numAccelerated	= 0;
+	}
+	++stats.numSweeps;
+	stats.lastResidual = rms;
+
+	m_sweep = iteration;
+	const float lastOmega = m_chebyshevOmega;
+	m_chebyshevOmega = 1.0f;
+
+	if( IsAccelerated() && iteration > 0 && m_previousResidual > 0.0f )
+	{
+		if( iteration <= CHEBYSHEV_DELAY )
+		{
+			const float rate = std::min( rms / m_previousResidual, MAX_SPECTRAL_RADIUS );
+			m_spectralRadius = ( 0.9f * m_spectralRadius ) + ( 0.1f * rate );
+		}
+
+		if( m_accelerating && rms > m_previousResidual * DIVERGENCE_RATIO )
+		{
+			m_accelerating		= false;
+			m_relaxScale		= 0.5f;
+			m_spectralRadius	*= 0.9f;
+			++stats.numFallbacks;
+		}
+	}
+	m_previousResidual		= rms;
+	stats.spectralRadius	= m_spectralRadius;
+
+	//the Chebyshev weights, from the first extrapolated sweep on
+	if( m_chebyshev && m_accelerating && IsAccelerated() && iteration >= CHEBYSHEV_DELAY )
+	{
+		const float rho2 = m_spectralRadius * m_spectralRadius;
+		m_chebyshevOmega = ( iteration == CHEBYSHEV_DELAY ) ? 2.0f / ( 2.0f - rho2 ) :
+							4.0f / ( 4.0f - ( rho2 * lastOmega ) );
+		++stats.numAccelerated;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: Extrapolate()
+// Desc: Pushes a run of particles on past the sweep just finished, away from
+//		 where they were two sweeps ago, by the Chebyshev weight
+//------------------------------------------------------------------------------
+void ParticleSystem::Extrapolate( const int first, const int count )
+{
+	if( m_chebyshevOmega == 1.0f )
+		return;
+
+	const D3DXVECTOR3* const pBefore = m_iterates[ ( m_sweep + 1 ) & 1 ];
+	for( int i = first; i < first + count; ++i )
+		m_pos[ i ] = pBefore[ i ] + ( m_pos[ i ] - pBefore[ i ] ) * m_chebyshevOmega;
+}
+
+//------------------------------------------------------------------------------
+// Name: Attach()
+// Desc: Holds a run of particles to their anchors. Each particle reads only
+//		 its own entries of the flat attachment arrays, so a run goes in one
+//		 pass with no order to keep, and any tile's job can take its own.
+//		 Every particle has an anchor, with those no anchor reaches left at
+//		 FLT_MAX, so the pass does the same branch-free work for each.
+//------------------------------------------------------------------------------
+void ParticleSystem::Attach( const int first, const int count )
+{
+	const D3DXVECTOR3* const pAnchors = &m_anchorPositions[ 0 ];
+	for( int i = first; i < first + count; ++i )
+		AttachParticle( m_pos[ i ], pAnchors[ m_attachAnchor[ i ] ], m_attachLength[ i ] );
+}
+
+//------------------------------------------------------------------------------
+// Name: StoreIterate()
+// Desc: Keeps a run of positions for extrapolating two sweeps on. Sweep k
+//		 stores to slot ( k + 1 ) & 1, and the positions going into the first
+//		 sweep to slot 0.
+//------------------------------------------------------------------------------
+void ParticleSystem::StoreIterate( const int first, const int count, const int slot )
+{
+	memcpy( m_iterates[ slot ] + first, m_pos + first, count * sizeof( D3DXVECTOR3 ) );
+}
+
+//------------------------------------------------------------------------------
+// Name: MeasureResidual()
+// Desc: Returns the root mean square error of the constraints as they stand
+//------------------------------------------------------------------------------
+float ParticleSystem::MeasureResidual() const
+{
+	double residual = 0.0;
+	for( int batch = 0; batch < m_numBatches; ++batch )
+	{
+		const ConstraintBatch& b = m_batches[ batch ];
+		for( int i = b.first; i < b.first + b.count; ++i )
+		{
+			const ClothConstraint& c = m_constraints[ i ];
+			const D3DXVECTOR3 vDelta = m_pos[ c.particleB ] - m_pos[ c.particleA ];
+			const double error = D3DXVec3Length( &vDelta ) - c.restLength;
+			residual += error * error;
+		}
+	}
+
+	return float( sqrt( residual / std::max( m_numConstraints, 1 ) ) );
+}
+
+//------------------------------------------------------------------------------
+// Name: MeasureMaxStretch()
+// Desc: Returns how far the most stretched constraint of a type is past its
+//		 rest length, as a share of that length
+//------------------------------------------------------------------------------
+float ParticleSystem::MeasureMaxStretch( const ConstraintType type ) const
+{
+	float maxStretch = 0.0f;
+	for( int batch = 0; batch < m_numBatches; ++batch )
+	{
+		const ConstraintBatch& b = m_batches[ batch ];
+		for( int i = b.first; i < b.first + b.count; ++i )
+		{
+			const ClothConstraint& c = m_constraints[ i ];
+			if( c.type != type )
+				continue;
+
+			const D3DXVECTOR3 vDelta = m_pos[ c.particleB ] - m_pos[ c.particleA ];
+			maxStretch = std::max( maxStretch,
+								   ( D3DXVec3Length( &vDelta ) / c.restLength ) - 1.0f );
+		}
+	}
+
+	return maxStretch;
 }
 
 //------------------------------------------------------------------------------
@@ -297,104 +1614,555 @@ void ParticleSystem::TimeStep()
 //------------------------------------------------------------------------------
 void ParticleSystem::Verlet()
 {
-	for( int i = 0; i < NUM_PARTICLES; ++i )
-	{
-		//get the current values for this particle
-		D3DXVECTOR3& vPos = m_pos[ i ];
-		D3DXVECTOR3 vTemp = vPos;
-		D3DXVECTOR3& vOld = m_oldPos[ i ];
-		D3DXVECTOR3& vAcc = m_acc[ i ];
-
-		//calculate the new position
-		vPos += vPos - vOld + vAcc * m_timeStep * m_timeStep;
-
-		//store the last position
-		vOld = vTemp;
-	}
+	Integrate( 0, m_numParticles );
+}
+
+//------------------------------------------------------------------------------
+// Name: Integrate()
+// Desc: Performs verlet integration on a run of particles with the selected
+//		 integrator
+//------------------------------------------------------------------------------
+void ParticleSystem::Integrate( const int first, const int count )
+{
+	IntegrateParams params;
+	params.pPos			= m_pos;
+	params.pState		= m_oldState;
+	params.pAcc			= m_acc;
+	params.timeStep		= m_timeStep / m_numSubsteps;
+	params.quantStep	= m_quantStep;
+	params.first		= first;
+	params.count		= count;
+
+	m_pIntegrator->pfnIntegrate( params );
+}
+
+//------------------------------------------------------------------------------
+// Name: CommitIntegration()
+// Desc: Lets an integrator that stores the old positions relative to the
+//		 current ones encode them, now the constraints have finished
+//------------------------------------------------------------------------------
+void ParticleSystem::CommitIntegration( const int first, const int count )
+{
+	if( m_pIntegrator->pfnCommit == NULL )
+		return;
+
+	IntegrateParams params;
+	params.pPos			= m_pos;
+	params.pState		= m_oldState;
+	params.pAcc			= m_acc;
+	params.timeStep		= m_timeStep / m_numSubsteps;
+	params.quantStep	= m_quantStep;
+	params.first		= first;
+	params.count		= count;
+
+	m_pIntegrator->pfnCommit( params );
+}
+
+//------------------------------------------------------------------------------
+// Name: SelectIntegrator()
+// Desc: Picks the integrator for a storage format and precision. Storage with
+//		 no float arithmetic instantiation integrates in double.
+//------------------------------------------------------------------------------
+void ParticleSystem::SelectIntegrator( const IntegratorStorage storage,
+									   const IntegratorPrecision precision )
+{
+	m_pIntegrator = FindIntegrator( storage, precision );
+	if( m_pIntegrator == NULL )
+		m_pIntegrator = FindIntegrator( storage, COMPUTE_DOUBLE );
+
+	m_quantStep = 0.0f;
+}
+
+//------------------------------------------------------------------------------
+// Name: GetOldPosition()
+// Desc: Returns a particle's old position, decoded from the integrator state
+//------------------------------------------------------------------------------
+D3DXVECTOR3 ParticleSystem::GetOldPosition( const int particle ) const
+{
+	return m_pIntegrator->pfnGetOld( m_oldState, m_pos, particle, m_quantStep );
+}
+
+//------------------------------------------------------------------------------
+// Name: SetOldPosition()
+// Desc: Sets a particle's old position. The current position must be set
+//		 first, as the compact formats store the difference between them.
+//------------------------------------------------------------------------------
+void ParticleSystem::SetOldPosition( const int particle, const D3DXVECTOR3& vOld )
+{
+	m_pIntegrator->pfnSetOld( m_oldState, m_pos, particle, vOld, m_quantStep );
+}
+
+//------------------------------------------------------------------------------
+// Name: UpdateTileBounds()
+// Desc: Refits the tile bounds to the particles, for a cloth that has been
+//		 reset rather than stepped. A step refits them as it collides.
+//------------------------------------------------------------------------------
+void ParticleSystem::UpdateTileBounds()
+{
+	SizeRunTiles();
+
+	for( int tile = 0; tile < m_numTiles; ++tile )
+		RefitTile( tile );
+}
+
+//------------------------------------------------------------------------------
+// Name: SizeRunTiles()
+// Desc: Fits the runs of particles to the number of live particles
+//------------------------------------------------------------------------------
+void ParticleSystem::SizeRunTiles()
+{
+	for( int tile = 0; tile < m_numTiles; ++tile )
+	{
+		ClothTile& t = m_tiles[ tile ];
+		if( t.stride == 0 )
+			t.columns = std::max( 0, std::min( m_tileDim * m_tileDim, m_numParticles - t.first ) );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: RefitTile()
+// Desc: Fits a tile's box around its particles
+//------------------------------------------------------------------------------
+void ParticleSystem::RefitTile( const int tile )
+{
+	if( m_tiles[ tile ].columns != 0 )
+		FitTile( m_pos, m_tiles[ tile ], m_tileMin[ tile ], m_tileMax[ tile ] );
+}
+
+//------------------------------------------------------------------------------
+// Name: CountCollisions()
+// Desc: Counts what the tile bounds saved on the step's last collision pass,
+//		 and the particle tests the tiles ran over the whole step, starting
+//		 their counts again for the next
+//------------------------------------------------------------------------------
+void ParticleSystem::CountCollisions()
+{
+	int numTiles = 0, numActiveTiles = 0, numParticleTests = 0;
+	for( int tile = 0; tile < m_numTiles; ++tile )
+	{
+		numParticleTests += m_tileTests[ tile ];
+		m_tileTests[ tile ] = 0;
+
+		if( m_tiles[ tile ].columns == 0 )
+			continue;
+		++numTiles;
+
+		if( m_tileActive[ tile ] )
+			++numActiveTiles;
+	}
+
+	m_collisionStats.numTiles			= numTiles;
+	m_collisionStats.numTilesCulled		= numTiles - numActiveTiles;
+	m_collisionStats.numParticleTests	= numParticleTests;
 }
 
 //------------------------------------------------------------------------------
 // Name: SatisfyConstraints()
-// Desc: Solves constraints for the simulation
-//------------------------------------------------------------------------------
-void ParticleSystem::SatisfyConstraints()
-{
-	for( int iteration = 0; iteration < NUM_ITERATIONS; ++iteration )
-	{
-		//constrain distances between particles
-		for( int constraint = 0; constraint < NUM_CONSTRAINTS; ++constraint )
-		{
-			//get the information for the current constraint
-			ClothConstraint& c	= m_constraints[ constraint ];
-			D3DXVECTOR3& v1		= m_pos[ c.particleA ];
-			D3DXVECTOR3& v2		= m_pos[ c.particleB ];
-
-			//calculate the constraint
-			D3DXVECTOR3 vDelta	= v2 - v1;
-			float deltaLength	= D3DXVec3Length( &vDelta );
-			float difference	= ( deltaLength - c.restLength ) / deltaLength;
-
-			//move the particles to meet the constraint
-			difference *= 0.5f;
-			v1 += vDelta * difference;
-			v2 -= vDelta * difference;
-		}
-
-		//constrain points to be outside the sphere
-		for( int particle = 0; particle < NUM_PARTICLES; ++particle )
-		{
-			//get the information for the current constraint
-			D3DXVECTOR3& v1	= m_pos[ particle ];
-			D3DXVECTOR3 v2	= ParticleSystem::SPHERE_POSITION;
-			float minLength	= ParticleSystem::SPHERE_RADIUS;
-
-			minLength += EDGE_CORRECTION;
-
-			//calculate the constraint
-			D3DXVECTOR3 vDelta	= v2 - v1;
-			float deltaLength	= D3DXVec3Length( &vDelta );
-			
-			//if point is inside the sphere, place it on the surface
-			if( deltaLength < minLength )
-			{
-				float difference = ( deltaLength - minLength ) / deltaLength;
-				v1 += vDelta * difference;
-			}
-		
-		}
-	}
-	
-	//fix one point of the cloth in space
-	//m_pos[ m_constraintParticle ] = m_constraintPosition;
+// Desc: Solves constraints for the simulation, looking for tears on the last
+//		 iteration if asked
+//------------------------------------------------------------------------------
+void ParticleSystem::SatisfyConstraints( const bool findTears )
+{
+	const float minLength = m_sphereRadius + EDGE_CORRECTION;
+
+	//use the specialised kernel if there is one for this grid
+	if( m_pKernel != NULL )
+	{
+		GridKernelParams params;
+		params.pPos				= m_pos;
+		params.space			= m_particleSpace;
+		params.diagonal			= m_diagonalSpace;
+		params.spherePosition	= m_spherePosition;
+		params.sphereMinLength	= minLength;
+		params.pTiles			= m_tiles;
+		params.numTiles			= m_numTiles;
+		params.pTileMin			= m_tileMin;
+		params.pTileMax			= m_tileMax;
+		params.pTileActive		= m_tileActive;
+		params.pTileTests		= m_tileTests;
+
+		m_pKernel->pfnSatisfyConstraints( params );
+		return;
+	}
+
+	const bool chebyshev = m_chebyshev && IsAccelerated();
+	if( chebyshev )
+		StoreIterate( 0, m_numParticles, 0 );
+
+	for( int iteration = 0; iteration < m_numIterations; ++iteration )
+	{
+		//look for tears on the last pass, once the cloth has settled
+		EndSweep( iteration, RelaxIteration( findTears && iteration == ( m_numIterations - 1 ) ) );
+		if( chebyshev )
+			Extrapolate( 0, m_numParticles );
+
+		//hold the cloth to its anchors
+		if( !m_anchors.empty() )
+			Attach( 0, m_numParticles );
+
+		//constrain points to be outside the sphere, where they can reach it
+		CollideTiles( m_pos, m_tiles, m_numTiles, m_spherePosition, minLength,
+					  m_tileMin, m_tileMax, m_tileActive, m_tileTests );
+
+		if( chebyshev )
+			StoreIterate( 0, m_numParticles, ( iteration + 1 ) & 1 );
+	}
+
+	if( m_numPendingTears > 0 )
+		ProcessTears();
+	
+	//fix one point of the cloth in space
+	//m_pos[ m_constraintParticle ] = m_constraintPosition;
 }
 
 //------------------------------------------------------------------------------
-// Name: AccumulateForces()
-// Desc: Accumulates the forces for each particle
+// Name: RelaxIteration()
+// Desc: Constrains distances between particles, one batch after another,
+//		 noting any constraints stretched far enough to tear. Returns the sum
+//		 of the squared errors the constraints started at, added up a job's
+//		 chunk at a time as the pipelined step does.
 //------------------------------------------------------------------------------
-void ParticleSystem::AccumulateForces()
+double ParticleSystem::RelaxIteration( const bool findTears )
 {
-	//all particles are under the influence of gravity
-	for( int particle = 0; particle < NUM_PARTICLES; ++particle )
+	const float tearScale = 1.0f + m_tearStrain;
+	double residual = 0.0, chunkResidual = 0.0;
+
+	for( int batch = 0; batch < m_numBatches; ++batch )
 	{
-		this->m_acc[ particle ] = m_gravity;
+		const int first	= m_batches[ batch ].first;
+		const int last	= first + m_batches[ batch ].count;
+
+		for( int constraint = first; constraint < last; ++constraint )
+		{
+			ClothConstraint& c = m_constraints[ constraint ];
+			const float length = m_solver == SOLVER_XPBD ?
+				RelaxCompliantConstraint( m_pos[ c.particleA ], m_pos[ c.particleB ],
+										  c.restLength, m_alphaTilde[ c.type ],
+										  m_lambda[ constraint ] ) :
+				RelaxConstraint( m_pos[ c.particleA ], m_pos[ c.particleB ], c.restLength,
+								 m_relaxScale );
+
+			const float error = length - c.restLength;
+			chunkResidual += error * error;
+			if( ( constraint - first ) % RELAX_CHUNK_SIZE == RELAX_CHUNK_SIZE - 1 ||
+				constraint == last - 1 )
+			{
+				residual += chunkResidual;
+				chunkResidual = 0.0;
+			}
+
+			if( findTears && c.type != CONSTRAINT_BEND &&
+				length > c.restLength * tearScale &&
+				m_numPendingTears < MAX_TEARS_PER_STEP )
+				m_pendingTears[ m_numPendingTears++ ] = constraint;
+		}
 	}
+
+	return residual;
 }
 
 //------------------------------------------------------------------------------
-// Name: GetFaceNormal()
-// Desc: Returns the face normal of a given triangle
+// Name: CollideTile()
+// Desc: Pushes the particles of one tile out of the sphere
 //------------------------------------------------------------------------------
-D3DXVECTOR3 ParticleSystem::GetFaceNormal( const D3DXVECTOR3& v1,
-										   const D3DXVECTOR3& v2,
-                                           const D3DXVECTOR3& v3 ) const
+void ParticleSystem::CollideTile( const int tile )
 {
-	D3DXVECTOR3 e1 = v2 - v1;
-	D3DXVECTOR3 e2 = v3 - v2;
+	CollideTiles( m_pos, m_tiles + tile, 1, m_spherePosition,
+				  m_sphereRadius + EDGE_CORRECTION, m_tileMin + tile, m_tileMax + tile,
+				  m_tileActive + tile, m_tileTests + tile );
+}
+
+//------------------------------------------------------------------------------
+// Name: ProcessTears()
+// Desc: Removes the constraints found overstretched this step and splits the
+//		 cloth where they were. Everything is patched where the tears are:
+//		 removals leave gaps at the ends of their batches rather than moving
+//		 the constraints after them down, the split particles share their
+//		 originals' adjacency lists, and only the attachments whose paths the
+//		 tears cut are searched for again.
+//------------------------------------------------------------------------------
+void ParticleSystem::ProcessTears()
+{
+	//the last of a batch moves down on removal, so work from the top
+	std::sort( m_pendingTears, m_pendingTears + m_numPendingTears );
+
+	while( m_numPendingTears > 0 )
+	{
+		const int slot = m_pendingTears[ --m_numPendingTears ];
+		if( slot < 0 )
+			continue;	//already removed by an earlier split
+
+		const ClothConstraint c = m_constraints[ slot ];
+		RemoveConstraint( slot );
+
+		//split the first particle across the line of the tear
+		SplitParticle( c.particleA, m_pos[ c.particleB ] - m_pos[ c.particleA ] );
+		++m_numTears;
+
+		//a torn grid no longer matches the specialised kernels
+		if( !m_torn )
+		{
+			m_torn = true;
+			SelectKernel();
+		}
+	}
+
+	//the runs take in the split particles, and the paths across the cloth to
+	//the anchors may be longer
+	SizeRunTiles();
+	m_tileNeighboursStale = true;
+	if( !m_attachStale.empty() )
+		RepairAttachments();
+}
+
+//------------------------------------------------------------------------------
+// Name: RemoveConstraint()
+// Desc: Removes a constraint in constant time by moving the last constraint of
+//		 its batch into its slot, leaving a gap at the end of the batch
+//------------------------------------------------------------------------------
+void ParticleSystem::RemoveConstraint( const int slot )
+{
+	//find the batch holding this slot
+	int low = 0, high = m_numBatches - 1;
+	while( low < high )
+	{
+		const int middle = ( low + high + 1 ) / 2;
+		if( m_batches[ middle ].first <= slot )
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	ConstraintBatch& batch = m_batches[ low ];
+	const int last = batch.first + batch.count - 1;
+
+	//a path to an anchor through the constraint is cut
+	const ClothConstraint& removed = m_constraints[ slot ];
+	if( removed.type != CONSTRAINT_BEND )
+	{
+		if( m_attachParent[ removed.particleB ] == removed.particleA )
+			DetachParticle( removed.particleB );
+		else if( m_attachParent[ removed.particleA ] == removed.particleB )
+			DetachParticle( removed.particleA );
+	}
+
+	//the lists at each end lose the slot, and the moved constraint's follow it
+	MoveConstraintSlot( m_constraints[ slot ].particleA, slot, -1 );
+	MoveConstraintSlot( m_constraints[ slot ].particleB, slot, -1 );
+	if( last != slot )
+	{
+		MoveConstraintSlot( m_constraints[ last ].particleA, last, slot );
+		MoveConstraintSlot( m_constraints[ last ].particleB, last, slot );
+	}
+
+	m_constraints[ slot ] = m_constraints[ last ];
+	--batch.count;
+	--m_numConstraints;
+
+	//keep the pending tears pointing at the right slots
+	for( int i = 0; i < m_numPendingTears; ++i )
+	{
+		if( m_pendingTears[ i ] == slot )
+			m_pendingTears[ i ] = -1;
+		else if( m_pendingTears[ i ] == last )
+			m_pendingTears[ i ] = slot;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: MoveConstraintSlot()
+// Desc: Points the entry for a constraint slot in a particle's list at
+//		 another slot, or at -1 once the constraint is gone
+//------------------------------------------------------------------------------
+void ParticleSystem::MoveConstraintSlot( const int particle, const int from, const int to )
+{
+	const int root = m_adjacencyRoot[ particle ];
+	for( int i = m_vertexConstraintStart[ root ]; i < m_vertexConstraintStart[ root + 1 ]; ++i )
+	{
+		if( m_vertexConstraints[ i ] == from )
+		{
+			m_vertexConstraints[ i ] = to;
+			return;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: SplitParticle()
+// Desc: Splits a particle in two along the plane through it facing along the
+//		 tear. Triangles and constraints on the far side move over to a new
+//		 copy of the particle, and bending constraints left bridging the gap
+//		 are removed. Only the triangles and constraints around the particle
+//		 are visited, found through the adjacency lists, and only their
+//		 indices are patched.
+//------------------------------------------------------------------------------
+void ParticleSystem::SplitParticle( const int particle, const D3DXVECTOR3& direction )
+{
+	if( m_numParticles >= m_maxParticles )
+		return;
+
 	D3DXVECTOR3 vNormal;
+	D3DXVec3Normalize( &vNormal, &direction );
+	const D3DXVECTOR3 vOrigin = m_pos[ particle ];
+
+	//the lists this particle's triangles and constraints are in
+	const int root				= m_adjacencyRoot[ particle ];
+	const int firstTriangle		= m_vertexTriangleStart[ root ];
+	const int lastTriangle		= m_vertexTriangleStart[ root + 1 ];
+	const int firstConstraint	= m_vertexConstraintStart[ root ];
+	const int lastConstraint	= m_vertexConstraintStart[ root + 1 ];
+
+	//sort the particle's triangles by side, noting their other corners
+	const int MAX_NEIGHBOURS = 64;
+	int neighbours[ MAX_NEIGHBOURS ];
+	int numNeighbours = 0, numFar = 0, numNear = 0;
+
+	for( int i = firstTriangle; i < lastTriangle; ++i )
+	{
+		const int* pTriangle = &m_triangles[ m_vertexTriangles[ i ] * 3 ];
+		if( pTriangle[ 0 ] != particle && pTriangle[ 1 ] != particle &&
+			pTriangle[ 2 ] != particle )
+			continue;
+
+		D3DXVECTOR3 vCenter = ( m_pos[ pTriangle[ 0 ] ] + m_pos[ pTriangle[ 1 ] ] +
+								m_pos[ pTriangle[ 2 ] ] ) / 3.0f - vOrigin;
+		if( D3DXVec3Dot( &vCenter, &vNormal ) > 0.0f )
+			++numFar;
+		else
+			++numNear;
+
+		for( int corner = 0; corner < 3; ++corner )
+		{
+			const int p = pTriangle[ corner ];
+			if( p != particle && numNeighbours < MAX_NEIGHBOURS &&
+				std::find( neighbours, neighbours + numNeighbours, p ) ==
+				neighbours + numNeighbours )
+				neighbours[ numNeighbours++ ] = p;
+		}
+	}
+
+	//nothing to split off if the cloth is all on one side
+	if( numFar == 0 || numNear == 0 )
+		return;
+
+	//make the copy, which shares the particle's lists until they are rebuilt
+	const int split = m_numParticles++;
+	m_pos[ split ]			= m_pos[ particle ];
+	memcpy( m_oldState + ( split * m_pIntegrator->stateSize ),
+			m_oldState + ( particle * m_pIntegrator->stateSize ), m_pIntegrator->stateSize );
+	m_acc[ split ]			= m_acc[ particle ];
+	m_texCoords[ split ]	= m_texCoords[ particle ];
+	m_adjacencyRoot[ split ]	= root;
+
+	//it has no path to an anchor until the search finds it one
+	m_attachAnchor[ split ]		= 0;
+	m_attachLength[ split ]		= FLT_MAX;
+	m_attachDistance[ split ]	= FLT_MAX;
+	m_attachParent[ split ]		= -1;
+	DetachParticle( split );
+
+	//move the far triangles over
+	bool rebuildIndices = false;
+	for( int i = firstTriangle; i < lastTriangle; ++i )
+	{
+		const int t = m_vertexTriangles[ i ];
+		int* pTriangle = &m_triangles[ t * 3 ];
+		if( pTriangle[ 0 ] != particle && pTriangle[ 1 ] != particle &&
+			pTriangle[ 2 ] != particle )
+			continue;
+
+		D3DXVECTOR3 vCenter = ( m_pos[ pTriangle[ 0 ] ] + m_pos[ pTriangle[ 1 ] ] +
+								m_pos[ pTriangle[ 2 ] ] ) / 3.0f - vOrigin;
+		if( D3DXVec3Dot( &vCenter, &vNormal ) <= 0.0f )
+			continue;
+
+		for( int corner = 0; corner < 3; ++corner )
+		{
+			if( pTriangle[ corner ] == particle )
+				pTriangle[ corner ] = split;
+		}
+
+		if( !m_indices.UpdateTriangle( t, pTriangle ) )
+			rebuildIndices = true;
+	}
+
+	//only a triangle spanning more than a 16-bit chunk can hold needs this
+	if( rebuildIndices )
+		m_indices.Build( m_triangles, m_numTriangles, m_numParticles );
 
-	D3DXVec3Cross( &vNormal, &e1, &e2 );
-	D3DXVec3Normalize( &vNormal, &vNormal );
+	//move the far constraints over
+	for( int i = firstConstraint; i < lastConstraint; ++i )
+	{
+		if( m_vertexConstraints[ i ] < 0 )
+			continue;	//removed
+
+		ClothConstraint& c = m_constraints[ m_vertexConstraints[ i ] ];
+		if( c.particleA != particle && c.particleB != particle )
+			continue;
+
+		const int other = ( c.particleA == particle ) ? c.particleB : c.particleA;
+		D3DXVECTOR3 vDelta = m_pos[ other ] - vOrigin;
+		if( D3DXVec3Dot( &vDelta, &vNormal ) <= 0.0f )
+			continue;
+
+		if( c.particleA == particle )
+			c.particleA = split;
+		else
+			c.particleB = split;
+
+		//which cuts any path to an anchor through it
+		if( m_attachParent[ other ] == particle )
+			DetachParticle( other );
+		else if( m_attachParent[ particle ] == other )
+			DetachParticle( particle );
+	}
+
+	//find the bends between neighbours left across the gap, each from its
+	//first particle's list
+	const int MAX_BENDS = 2 * MAX_NEIGHBOURS;
+	int bends[ MAX_BENDS ];
+	int numBends = 0;
 
-	return vNormal;
+	for( int n = 0; n < numNeighbours; ++n )
+	{
+		const int neighbour = neighbours[ n ];
+		const int neighbourRoot = m_adjacencyRoot[ neighbour ];
+
+		for( int i = m_vertexConstraintStart[ neighbourRoot ];
+			 i < m_vertexConstraintStart[ neighbourRoot + 1 ] && numBends < MAX_BENDS; ++i )
+		{
+			if( m_vertexConstraints[ i ] < 0 )
+				continue;
+
+			const ClothConstraint& c = m_constraints[ m_vertexConstraints[ i ] ];
+			if( c.particleA != neighbour || c.type != CONSTRAINT_BEND ||
+				std::find( neighbours, neighbours + numNeighbours, c.particleB ) ==
+				neighbours + numNeighbours )
+				continue;
+
+			D3DXVECTOR3 vDeltaA = m_pos[ c.particleA ] - vOrigin;
+			D3DXVECTOR3 vDeltaB = m_pos[ c.particleB ] - vOrigin;
+			if( ( D3DXVec3Dot( &vDeltaA, &vNormal ) > 0.0f ) !=
+				( D3DXVec3Dot( &vDeltaB, &vNormal ) > 0.0f ) )
+				bends[ numBends++ ] = m_vertexConstraints[ i ];
+		}
+	}
+
+	//remove them from the top down, as removal moves the last of a batch down
+	std::sort( bends, bends + numBends );
+	while( numBends > 0 )
+		RemoveConstraint( bends[ --numBends ] );
+}
+
+//------------------------------------------------------------------------------
+// Name: AccumulateForces()
+// Desc: Accumulates the forces for each particle
+//------------------------------------------------------------------------------
+void ParticleSystem::AccumulateForces()
+{
+	//all particles are under the influence of gravity
+	for( int particle = 0; particle < m_numParticles; ++particle )
+	{
+		this->m_acc[ particle ] = m_gravity;
+	}
 }
\ No newline at end of file
@@ -15,13 +15,21 @@
 //------------------------------------------------------------------------------
 // Included files:
 //------------------------------------------------------------------------------
+#include <vector>
 #include <d3dx9.h>
+#include "ClothIndices.h"
+#include "ClothArena.h"
+#include "JobSystem.h"
 
 
 //------------------------------------------------------------------------------
 // Prototypes and declarations:
 //------------------------------------------------------------------------------
 
+struct GridKernelEntry;
+struct IntegratorEntry;
+struct ClothMesh;
+
 //------------------------------------------------------------------------------
 // Name: struct CLOTH_VERTEX
 // Desc: A single vertex in the cloth model
@@ -34,16 +42,110 @@ struct CLOTH_VERTEX
 };
 const DWORD D3DFVF_CLOTHVERTEX = D3DFVF_XYZ | D3DFVF_NORMAL | D3DFVF_TEX1;
 
-//------------------------------------------------------------------------------
-// Name: struct ClothConstraint
-// Desc: A structure representing an infinite spring constraint
-//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+// Name: enum ConstraintType
+// Desc: What a constraint holds the cloth against
+//------------------------------------------------------------------------------
+enum ConstraintType
+{
+	CONSTRAINT_STRUCTURAL = 0,	//stretching along the weave
+	CONSTRAINT_SHEAR,			//shearing across the weave
+	CONSTRAINT_BEND,			//folding
+	NUM_CONSTRAINT_TYPES
+};
+
+//------------------------------------------------------------------------------
+// Name: struct ClothConstraint
+// Desc: A structure representing an infinite spring constraint
+//------------------------------------------------------------------------------
 struct ClothConstraint
 {
 	int particleA, particleB;
 	float restLength;
+	int type;
+};
+
+//------------------------------------------------------------------------------
+// Name: struct ConstraintBatch
+// Desc: A run of constraints that share no particles with each other
+//------------------------------------------------------------------------------
+struct ConstraintBatch
+{
+	int first;
+	int count;
+};
+
+//------------------------------------------------------------------------------
+// Name: struct ClothTile
+// Desc: A block of particles with one bounding box. Particle (row, column) of
+//		 the tile is first + row * stride + column.
+//------------------------------------------------------------------------------
+struct ClothTile
+{
+	int first;
+	int rows;
+	int columns;
+	int stride;
+};
+
+//------------------------------------------------------------------------------
+// Name: struct CollisionStats
+// Desc: How much of the collision work the tile bounds saved in the last step
+//------------------------------------------------------------------------------
+struct CollisionStats
+{
+	int numTiles;			//tiles holding particles
+	int numTilesCulled;		//tiles that missed the collider
+	int numParticleTests;	//particle tests run, over all iterations
+};
+
+//------------------------------------------------------------------------------
+// Name: struct SolverStats
+// Desc: How the generic relaxation converged in the last substep. Residuals
+//		 are the root mean square constraint error met during a sweep.
+//------------------------------------------------------------------------------
+struct SolverStats
+{
+	int		numSweeps;			//relaxation iterations run
+	float	firstResidual;		//during the first sweep
+	float	lastResidual;		//during the last sweep
+	float	spectralRadius;		//estimated convergence rate of plain sweeps
+	int		numAccelerated;		//sweeps Chebyshev extrapolated
+	int		numFallbacks;		//divergences caught since the cloth was reset
 };
 
+//------------------------------------------------------------------------------
+// Name: enum IntegratorStorage
+// Desc: How the integrator keeps each particle's old position
+//------------------------------------------------------------------------------
+enum IntegratorStorage
+{
+	STORE_FLOAT = 0,		//32-bit old position
+	STORE_HALF,				//16-bit float offset from the current position
+	STORE_QUANTISED,		//16-bit fixed point offset from the current position
+	STORE_DOUBLE			//64-bit current and old positions
+};
+
+//------------------------------------------------------------------------------
+// Name: enum IntegratorPrecision
+// Desc: The arithmetic the integrator steps the particles in
+//------------------------------------------------------------------------------
+enum IntegratorPrecision
+{
+	COMPUTE_FLOAT = 0,
+	COMPUTE_DOUBLE
+};
+
+//------------------------------------------------------------------------------
+// Name: enum ConstraintSolver
+// Desc: How the constraints are relaxed
+//------------------------------------------------------------------------------
+enum ConstraintSolver
+{
+	SOLVER_JAKOBSEN = 0,	//projection - stiffer with more iterations and substeps
+	SOLVER_XPBD				//compliant - stiffness set by each type's compliance
+};
+
 //------------------------------------------------------------------------------
 // Name: class ParticleSystem
 // Desc: The cloth model particle system
@@ -51,44 +153,316 @@ struct ClothConstraint
 class ParticleSystem
 {
 public:
-	const static int PRTS_PER_DIM = 64;
-	const static int NUM_PARTICLES = PRTS_PER_DIM * PRTS_PER_DIM;
+	const static int DEFAULT_PRTS_PER_DIM = 64;
+	const static int MAX_TEARS_PER_STEP = 8;
+	const static int DEFAULT_TILE_DIM = 8;		//grid tiles are this many particles square
+	const static int MIN_TILE_DIM = 4;
+	const static int MAX_TILE_DIM = 16;
+	const static int RELAX_CHUNK_SIZE = 2048;	//mesh constraints per job
+	const static float DEFAULT_TEAR_STRAIN;
+	const static float DEFAULT_ATTACHMENT_STRETCH;
+	const static float DEFAULT_COMPLIANCE[ NUM_CONSTRAINT_TYPES ];
+	const static int CHEBYSHEV_DELAY = 2;		//plain sweeps before extrapolating
+	const static float MAX_SPECTRAL_RADIUS;
+	const static float DIVERGENCE_RATIO;		//residual growth taken as diverging
 
 	const static float SPHERE_RADIUS;
 	const static D3DXVECTOR3 SPHERE_POSITION;
 	const static float EDGE_CORRECTION;
 
-	ParticleSystem();
+	//given a job system, the workers place the cloth's memory - see
+	//ClothArena::FirstTouch(). The storage and precision pick the integrator;
+	//double storage always integrates in double.
+	ParticleSystem( const int prtsPerDim = DEFAULT_PRTS_PER_DIM, JobSystem* pJobs = NULL,
+					const IntegratorStorage storage = STORE_FLOAT,
+					const IntegratorPrecision precision = COMPUTE_FLOAT );
+	ParticleSystem( const ClothMesh& mesh, JobSystem* pJobs = NULL,
+					const IntegratorStorage storage = STORE_FLOAT,
+					const IntegratorPrecision precision = COMPUTE_FLOAT );
 	~ParticleSystem();
 
 	void Initialise();
+	void Resample( const ParticleSystem& source );
 
 	HRESULT FillVertexBuffer( const LPDIRECT3DVERTEXBUFFER9 pVB ) const;
 	HRESULT FillIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB ) const;
+	HRESULT UpdateIndexBuffer( const LPDIRECT3DINDEXBUFFER9 pIB );
 
 	void TimeStep();
 
+	//steps the cloth as a graph of per-tile jobs, writing the vertices of the
+	//result to pVertices. Nothing else may touch the cloth until EndTimeStep().
+	void BeginTimeStep( JobSystem& jobs, CLOTH_VERTEX* pVertices );
+	void EndTimeStep( JobSystem& jobs );
+
 	void SetTimeStep( const float timeStep ) { m_timeStep = timeStep; }
+	void SetNumIterations( const int numIterations );
+	void SetNumSubsteps( const int numSubsteps );
+
+	//under XPBD a constraint type's compliance, the inverse of its stiffness,
+	//fixes how it stretches whatever the iterations, time step and substeps.
+	//Zero compliance is rigid.
+	void SetSolver( const ConstraintSolver solver );
+	void SetCompliance( const ConstraintType type, const float compliance );
+
+	//speed up the projection solver: over-relaxation scales each correction
+	//(1 is plain projection, below 2 to converge) and Chebyshev extrapolates
+	//across sweeps. Both fall back to plain sweeps for the rest of a substep
+	//if the residual grows.
+	void SetOverRelaxation( const float factor );
+	void SetChebyshev( const bool enable );
+	void SetTearing( const bool enable, const float tearStrain = DEFAULT_TEAR_STRAIN );
+
+	//pins a particle where it is now, or frees it again. Anchors go back to
+	//their particles' rest positions on Initialise(). Unless attachments are
+	//turned off, every other particle is also kept within its rest distance
+	//across the cloth from the nearest anchor, plus the stretch, which holds
+	//a long cloth taut at few iterations.
+	void SetAnchor( const int particle, const bool anchored );
+	void ClearAnchors();
+	void SetAttachments( const bool enable,
+						 const float stretch = DEFAULT_ATTACHMENT_STRETCH );
+
+	//recuts the cloth into tiles of another size, between MIN_TILE_DIM and
+	//MAX_TILE_DIM, and lets the specialised grid kernel be used or not.
+	//Neither may be called while a step is running.
+	void SetTileDim( const int tileDim );
+	void SetSpecialisation( const bool enable );
+
+	//deterministic stepping gives bit-identical particles however many workers
+	//run the step and whatever tile size it is cut into: the jobs inherit the
+	//stepping thread's floating-point mode and the specialised grid kernels,
+	//which not every machine's tuning picks, are left out. Runs to be compared
+	//must still share a storage format. The checksum of the positions is cheap
+	//enough to take every step.
+	void SetDeterministic( const bool enable );
+	DWORD GetChecksum() const;
+
+	//moves the sphere the cloth collides with, from the next step on
+	void SetSphere( const D3DXVECTOR3& vPosition, const float radius );
 	D3DXVECTOR3 GetPosition() const { return m_pos[ m_constraintParticle ]; }
 
+	int GetPrtsPerDim() const { return m_prtsPerDim; }
+	int GetConstraintParticle() const { return m_constraintParticle; }
+	int GetNumAnchors() const { return int( m_anchors.size() ); }
+	int GetNumParticles() const { return m_numParticles; }
+	int GetMaxParticles() const { return m_maxParticles; }
+	bool IsTearing() const { return m_tearing; }
+	int GetNumTears() const { return m_numTears; }
+	int GetNumTriangles() const { return m_numTriangles; }
+	const int* GetTriangles() const { return m_triangles; }
+	const ClothIndices& GetIndices() const { return m_indices; }
+	bool IsGrid() const { return m_prtsPerDim != 0; }
+	float GetTimeStep() const { return m_timeStep; }
+	int GetNumIterations() const { return m_numIterations; }
+	int GetNumSubsteps() const { return m_numSubsteps; }
+	ConstraintSolver GetSolver() const { return m_solver; }
+	float GetOverRelaxation() const { return m_overRelaxation; }
+	bool IsChebyshev() const { return m_chebyshev; }
+	const SolverStats& GetSolverStats() const { return m_solverStats; }
+	float MeasureResidual() const;
+	float MeasureMaxStretch( const ConstraintType type = CONSTRAINT_STRUCTURAL ) const;
+	bool IsSpecialised() const { return m_pKernel != NULL; }
+	int GetTileDim() const { return m_tileDim; }
+	bool IsDeterministic() const { return m_deterministic; }
+	bool IsTorn() const { return m_torn; }
+	void GetBounds( D3DXVECTOR3& vMin, D3DXVECTOR3& vMax ) const;
+	float GetCurvature() const;
+	const CollisionStats& GetCollisionStats() const { return m_collisionStats; }
+	const ArenaStats& GetArenaStats() const { return m_arena.GetStats(); }
+	const IntegratorEntry& GetIntegrator() const { return *m_pIntegrator; }
+	const D3DXVECTOR3& GetSpherePosition() const { return m_spherePosition; }
+	float GetSphereRadius() const { return m_sphereRadius; }
+	const D3DXVECTOR3& GetParticlePosition( const int particle ) const { return m_pos[ particle ]; }
+	D3DXVECTOR3 GetOldPosition( const int particle ) const;
+
 private:
-	const static int NUM_CONSTRAINTS = ( ( PRTS_PER_DIM - 1 ) * PRTS_PER_DIM * 2 ) +
-									   ( ( PRTS_PER_DIM - 1 ) * ( PRTS_PER_DIM - 1 ) ) +
-									   ( ( PRTS_PER_DIM - 2 ) * PRTS_PER_DIM * 2 );
-	const static int NUM_ITERATIONS = 1;
+	void Allocate( const int numParticles, const int numConstraints,
+				   const int numTriangles, const int numBatches, JobSystem* pJobs );
+	void CarveArrays();
+	void BuildGridTriangles();
+	void SelectIntegrator( const IntegratorStorage storage,
+						   const IntegratorPrecision precision );
+	void SetOldPosition( const int particle, const D3DXVECTOR3& vOld );
+	void SelectKernel();
+	int CountTiles( const int tileDim ) const;
+	void BuildTiles();
+	void BuildAdjacency();
+	void BuildTileNeighbours();
+	void BuildConstraintAdjacency();
+	int GetParticleTile( const int particle ) const;
+
+	void PlaceAnchors();
+	void BuildAttachments();
+	void DetachParticle( const int particle );
+	void RepairAttachments();
+	void SearchAttachments();
+	void Attach( const int first, const int count );
+
+	void ProcessTears();
+	void RemoveConstraint( const int slot );
+	void MoveConstraintSlot( const int particle, const int from, const int to );
+	void SplitParticle( const int particle, const D3DXVECTOR3& direction );
 
 	void Verlet();
-	void SatisfyConstraints();
+	void Integrate( const int first, const int count );
+	void CommitIntegration( const int first, const int count );
+	void UpdateTileBounds();
+	void SizeRunTiles();
+	void RefitTile( const int tile );
+	void CountCollisions();
+	void PrepareSolver();
+	void BeginRelaxation();
+	bool IsAccelerated() const;
+	void SatisfyConstraints( const bool findTears );
+	double RelaxIteration( const bool findTears );
+	void EndSweep( const int iteration, const double residual );
+	void Extrapolate( const int first, const int count );
+	void StoreIterate( const int first, const int count, const int slot );
+	void CollideTile( const int tile );
 	void AccumulateForces();
 
-	D3DXVECTOR3 GetFaceNormal( const D3DXVECTOR3& v1, const D3DXVECTOR3& v2,
-							   const D3DXVECTOR3& v3 ) const;
+	void FillVertices( CLOTH_VERTEX* pBuffer ) const;
+	void FillMeshVertices( CLOTH_VERTEX* pBuffer ) const;
+	void FillTileVertices( const int tile, CLOTH_VERTEX* pBuffer ) const;
+	void FillVertex( const int particle, CLOTH_VERTEX& v ) const;
+
+	//the jobs of a pipelined step
+	void BuildStepGraph();
+	static void ForcesJob( void* pContext, const int tile );
+	static void IntegrateJob( void* pContext, const int tile );
+	static void CommitJob( void* pContext, const int tile );
+	static void BeginRelaxationJob( void* pContext, const int unused );
+	static void RelaxJob( void* pContext, const int findTears );
+	static void EndSweepJob( void* pContext, const int sweep );
+	static void RelaxChunkJob( void* pContext, const int chunk );
+	static void CollideJob( void* pContext, const int tile );
+	static void TearJob( void* pContext, const int unused );
+	static void EmitJob( void* pContext, const int tile );
+
+	int m_prtsPerDim;		//zero for a mesh cloth
+	int m_numParticles;
+	int m_maxParticles;		//room for particles split off by tearing
+	int m_numConstraints;	//live ones, as tears leave gaps at the ends of batches
+	int m_numIterations;
+	int m_numSubsteps;		//integrations and relaxations per time step
+	int m_numTriangles;
+	int m_numBatches;
+
+	ClothArena m_arena;		//holds every array of the cloth
+
+	D3DXVECTOR3* m_pos;		//current particle positions
+	BYTE* m_oldState;		//old particle positions, in the integrator's format
+	D3DXVECTOR3* m_acc;		//force accumulators
+
+	D3DXVECTOR2* m_texCoords;		//texture coordinates per particle
+
+	ClothConstraint* m_constraints;
+	ConstraintBatch* m_batches;		//runs of m_constraints, independent for a mesh
+
+	int* m_triangles;				//three particles per triangle
+	ClothIndices m_indices;			//render-ready index list for m_triangles
+	ClothIndices m_restIndices;		//the untorn list, copied back on reset
+
+	//the triangles around each particle, for gathering vertex normals
+	int* m_vertexTriangleStart;
+	int* m_vertexTriangles;
+
+	//the constraint slots at each particle, for tearing. A particle split off
+	//since the lists were built uses its original's, which cover it, in both
+	//these and the triangle lists, picking out the entries that hold it.
+	int* m_vertexConstraintStart;
+	int* m_vertexConstraints;
+	int* m_adjacencyRoot;
+
+	//the untorn cloth
+	int m_numRestParticles;
+	int m_numRestConstraints;
+	int m_numRestBatches;
+
+	//mesh cloth only
+	D3DXVECTOR3*		m_restPos;			//starting particle positions
+	D3DXVECTOR2*		m_restTexCoords;
+	ClothConstraint*	m_restConstraints;
+	ConstraintBatch*	m_restBatches;
+	int*				m_restTriangles;
+
+	//tearing
+	bool	m_tearing;
+	float	m_tearStrain;
+	bool	m_torn;			//has the topology changed since Initialise()?
+	int		m_pendingTears[ MAX_TEARS_PER_STEP ];
+	int		m_numPendingTears;
+	int		m_numTears;
+
+	//anchors, and the long-range attachments to the nearest of them
+	std::vector< int >			m_anchors;			//pinned particles
+	std::vector< D3DXVECTOR3 >	m_anchorPositions;	//where each is pinned
+	int*						m_attachAnchor;		//each particle's nearest
+	float*						m_attachLength;		//furthest from it, FLT_MAX for none
+	float*						m_attachDistance;	//the same before the stretch
+	int*						m_attachParent;		//previous on the path, -1 for none
+	std::vector< std::pair< float, int > >	m_attachOpen;	//search heap, kept
+	std::vector< int >			m_attachStale;		//paths cut by tears, kept
+	bool						m_attachments;
+	float						m_attachStretch;
+
+	//collision culling
+	ClothTile*		m_tiles;
+	int				m_numTiles;
+	int				m_maxTiles;			//at the smallest tile size
+	int				m_tileDim;
+	D3DXVECTOR3*	m_tileMin;			//bounds as of the last collision pass
+	D3DXVECTOR3*	m_tileMax;
+	bool*			m_tileActive;		//did the tile reach the sphere on it?
+	int*			m_tileTests;		//particle tests run since the last count
+	float			m_maxRestLength;	//longest constraint, for quantising
+	CollisionStats	m_collisionStats;
+
+	//tiles whose particles share triangles with each tile's, itself included
+	std::vector< int > m_tileNeighbourStart;
+	std::vector< int > m_tileNeighbours;
+	int* m_tileStamp;				//last tile each was listed for
+	bool m_tileNeighboursStale;		//torn since they were listed?
+
+	//pipelined stepping
+	JobGraph						m_stepGraph;
+	CLOTH_VERTEX*					m_pStepVertices;
+	std::vector< ConstraintBatch >	m_relaxChunks;	//mesh batches, split for jobs
+	std::vector< double >			m_chunkResiduals;
+	std::vector< int >				m_sweepChunkStart;	//each sweep's first chunk
+	double							m_sweepResidual;	//from a whole-sweep job
+
+	//the integrator's storage format and arithmetic
+	const IntegratorEntry*	m_pIntegrator;
+	float					m_quantStep;	//for quantised storage
+
+	//specialised kernels for this grid, NULL for the generic path
+	const GridKernelEntry* m_pKernel;
+	bool m_specialisation;		//may m_pKernel be used at all?
+	bool m_deterministic;
+
+	//constraint solver
+	ConstraintSolver	m_solver;
+	float				m_compliance[ NUM_CONSTRAINT_TYPES ];
+	float				m_alphaTilde[ NUM_CONSTRAINT_TYPES ];	//compliance / substep^2
+	float*				m_lambda;		//XPBD multipliers, one per constraint
 
-	D3DXVECTOR3 m_pos[ PRTS_PER_DIM * PRTS_PER_DIM ];		//current particle positions
-	D3DXVECTOR3 m_oldPos[ PRTS_PER_DIM * PRTS_PER_DIM ];	//old particle positions
-	D3DXVECTOR3 m_acc[ PRTS_PER_DIM * PRTS_PER_DIM ];		//force accumulators
+	//acceleration of the projection solver
+	float			m_overRelaxation;
+	bool			m_chebyshev;
+	float			m_relaxScale;		//share of a correction each particle takes
+	bool			m_accelerating;		//no divergence yet this substep
+	float			m_chebyshevOmega;	//weight of the sweep just finished
+	float			m_spectralRadius;
+	float			m_previousResidual;
+	int				m_sweep;			//iteration of the substep just finished
+	D3DXVECTOR3*	m_iterates[ 2 ];	//positions after alternate sweeps
+	SolverStats		m_solverStats;
 
-	ClothConstraint m_constraints[ NUM_CONSTRAINTS ];
+	//the collider
+	D3DXVECTOR3 m_spherePosition;
+	float		m_sphereRadius;
 
 	//fixed particle
 	int			m_constraintParticle;
@@ -96,6 +470,8 @@ private:
 
 	D3DXVECTOR3 m_gravity;
 	float		m_timeStep;
+	float		m_particleSpace;
+	float		m_diagonalSpace;
 
 };
 
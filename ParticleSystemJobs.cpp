@@ -0,0 +1,406 @@
+//------------------------------------------------------------------------------
+// File: ParticleSystemJobs.cpp
+// Desc: The cloth time step as a graph of jobs for the worker threads
+//
+// Created: 18 October 2026 16:15:47
+//
+// (c)2026 the Cloth contributors
+//------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+// Included files:
+//------------------------------------------------------------------------------
+#define NOMINMAX		//std::min and std::max, not the windows.h macros
+
+//no fused multiply-adds in the jobs, as in ParticleSystem.cpp
+#if defined( _MSC_VER ) && _MSC_VER >= 1400
+#pragma fp_contract( off )
+#endif
+
+#include <algorithm>
+#include "ParticleSystem.h"
+#include "GridKernels.h"
+#include "Integrators.h"
+
+
+//------------------------------------------------------------------------------
+// Definitions:
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Name: BeginTimeStep()
+// Desc: Starts a time step running on the job system. Each tile's vertices are
+//		 written to pVertices as soon as that part of the cloth is final, so
+//		 the caller can carry on with the frame in the meantime.
+//------------------------------------------------------------------------------
+void ParticleSystem::BeginTimeStep( JobSystem& jobs, CLOTH_VERTEX* pVertices )
+{
+	m_pStepVertices = pVertices;
+
+	BuildStepGraph();
+	jobs.Submit( m_stepGraph );
+}
+
+//------------------------------------------------------------------------------
+// Name: EndTimeStep()
+// Desc: Waits for the time step started by BeginTimeStep() to finish
+//------------------------------------------------------------------------------
+void ParticleSystem::EndTimeStep( JobSystem& jobs )
+{
+	jobs.Wait( m_stepGraph );
+	m_pStepVertices = NULL;
+
+	CountCollisions();
+}
+
+//------------------------------------------------------------------------------
+// Name: BuildStepGraph()
+// Desc: Builds the jobs of one time step, giving the same result as
+//		 TimeStep() followed by FillVertices(). Forces and integration run per
+//		 tile. Relaxation is Gauss-Seidel over the whole cloth, so it stays one
+//		 job per iteration, except that a mesh's independent batches are cut
+//		 into chunks. Collision runs per tile, and each tile's vertices are
+//		 built once it and the tiles it shares triangles with have collided
+//		 for the last time. Tearing changes the topology, so it waits for
+//		 every tile and the vertices wait for it.
+//------------------------------------------------------------------------------
+void ParticleSystem::BuildStepGraph()
+{
+	m_stepGraph.Clear();
+	m_relaxChunks.clear();
+	m_sweepChunkStart.clear();
+
+	SizeRunTiles();
+	PrepareSolver();
+
+	int previous	= -1;
+	int lastCollide	= -1;	//the first tile's collision on the last iteration
+
+	for( int substep = 0; substep < m_numSubsteps; ++substep )
+	{
+		//forces and integration, after the last substep, all finished before
+		//relaxation reaches across the tiles
+		const int integrated = m_stepGraph.AddBarrier();
+		for( int tile = 0; tile < m_numTiles; ++tile )
+		{
+			const int forces	= m_stepGraph.AddJob( ForcesJob, this, tile );
+			const int integrate	= m_stepGraph.AddJob( IntegrateJob, this, tile );
+			m_stepGraph.AddDependency( integrate, forces );
+			m_stepGraph.AddDependency( integrated, integrate );
+			if( previous >= 0 )
+				m_stepGraph.AddDependency( forces, previous );
+		}
+
+		//the XPBD multipliers and the acceleration start each substep afresh
+		if( m_pKernel == NULL )
+		{
+			const int begin = m_stepGraph.AddJob( BeginRelaxationJob, this, 0 );
+			m_stepGraph.AddDependency( integrated, begin );
+			if( previous >= 0 )
+				m_stepGraph.AddDependency( begin, previous );
+		}
+
+		previous = integrated;
+
+		for( int iteration = 0; iteration < m_numIterations; ++iteration )
+		{
+			const bool findTears = m_tearing && substep == ( m_numSubsteps - 1 ) &&
+								   iteration == ( m_numIterations - 1 );
+			const int sweep = int( m_sweepChunkStart.size() );
+			m_sweepChunkStart.push_back( int( m_relaxChunks.size() ) );
+
+			//relax the constraints
+			if( !IsGrid() && !findTears )
+			{
+				for( int batch = 0; batch < m_numBatches; ++batch )
+				{
+					const int barrier = m_stepGraph.AddBarrier();
+
+					const ConstraintBatch& b = m_batches[ batch ];
+					for( int first = b.first; first < b.first + b.count; first += RELAX_CHUNK_SIZE )
+					{
+						ConstraintBatch chunk;
+						chunk.first = first;
+						chunk.count = std::min( int( RELAX_CHUNK_SIZE ), b.first + b.count - first );
+						m_relaxChunks.push_back( chunk );
+
+						const int job = m_stepGraph.AddJob( RelaxChunkJob, this,
+															int( m_relaxChunks.size() ) - 1 );
+						m_stepGraph.AddDependency( job, previous );
+						m_stepGraph.AddDependency( barrier, job );
+					}
+
+					m_stepGraph.AddDependency( barrier, previous );
+					previous = barrier;
+				}
+			}
+			else
+			{
+				const int relax = m_stepGraph.AddJob( RelaxJob, this, findTears ? 1 : 0 );
+				m_stepGraph.AddDependency( relax, previous );
+				previous = relax;
+			}
+
+			//gather the residual and settle the extrapolation
+			if( m_pKernel == NULL )
+			{
+				const int end = m_stepGraph.AddJob( EndSweepJob, this, sweep );
+				m_stepGraph.AddDependency( end, previous );
+				previous = end;
+			}
+
+			//collide each tile, all before the next iteration starts
+			const int barrier = m_stepGraph.AddBarrier();
+			lastCollide = m_stepGraph.GetNumJobs();
+			for( int tile = 0; tile < m_numTiles; ++tile )
+			{
+				const int collide = m_stepGraph.AddJob( CollideJob, this, tile );
+				m_stepGraph.AddDependency( collide, previous );
+				m_stepGraph.AddDependency( barrier, collide );
+			}
+			previous = barrier;
+		}
+
+		//a compact integrator encodes the old positions once nothing moves the
+		//particles, and before tearing copies them to split particles
+		if( m_pIntegrator->pfnCommit != NULL )
+		{
+			const int commit = m_stepGraph.AddBarrier();
+			for( int tile = 0; tile < m_numTiles; ++tile )
+			{
+				const int job = m_stepGraph.AddJob( CommitJob, this, tile );
+				m_stepGraph.AddDependency( job, previous );
+				m_stepGraph.AddDependency( commit, job );
+			}
+			previous = commit;
+		}
+	}
+
+	m_sweepChunkStart.push_back( int( m_relaxChunks.size() ) );
+	m_chunkResiduals.resize( m_relaxChunks.size() );
+
+	//tearing rebuilds the topology the vertices are built from
+	if( m_tearing || lastCollide < 0 )
+	{
+		const int tear = m_stepGraph.AddJob( TearJob, this, 0 );
+		m_stepGraph.AddDependency( tear, previous );
+
+		for( int tile = 0; tile < m_numTiles; ++tile )
+		{
+			const int emit = m_stepGraph.AddJob( EmitJob, this, tile );
+			m_stepGraph.AddDependency( emit, tear );
+		}
+		return;
+	}
+
+	//bring the tile lists up to date once any tearing has stopped
+	if( m_tileNeighboursStale )
+		BuildTileNeighbours();
+
+	for( int tile = 0; tile < m_numTiles; ++tile )
+	{
+		const int emit = m_stepGraph.AddJob( EmitJob, this, tile );
+		for( int i = m_tileNeighbourStart[ tile ]; i < m_tileNeighbourStart[ tile + 1 ]; ++i )
+			m_stepGraph.AddDependency( emit, lastCollide + m_tileNeighbours[ i ] );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: ForcesJob()
+// Desc: Accumulates the forces on one tile's particles
+//------------------------------------------------------------------------------
+void ParticleSystem::ForcesJob( void* pContext, const int tile )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+	const ClothTile& t = pSystem->m_tiles[ tile ];
+
+	for( int row = 0; row < t.rows; ++row )
+	{
+		const int first = t.first + ( row * t.stride );
+		for( int particle = first; particle < first + t.columns; ++particle )
+			pSystem->m_acc[ particle ] = pSystem->m_gravity;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: IntegrateJob()
+// Desc: Performs verlet integration on one tile's particles
+//------------------------------------------------------------------------------
+void ParticleSystem::IntegrateJob( void* pContext, const int tile )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+	const ClothTile& t = pSystem->m_tiles[ tile ];
+
+	const bool chebyshev = pSystem->m_chebyshev && pSystem->IsAccelerated();
+
+	for( int row = 0; row < t.rows; ++row )
+	{
+		pSystem->Integrate( t.first + ( row * t.stride ), t.columns );
+		if( chebyshev )
+			pSystem->StoreIterate( t.first + ( row * t.stride ), t.columns, 0 );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: CommitJob()
+// Desc: Encodes one tile's old positions for a compact integrator
+//------------------------------------------------------------------------------
+void ParticleSystem::CommitJob( void* pContext, const int tile )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+	const ClothTile& t = pSystem->m_tiles[ tile ];
+
+	for( int row = 0; row < t.rows; ++row )
+		pSystem->CommitIntegration( t.first + ( row * t.stride ), t.columns );
+}
+
+//------------------------------------------------------------------------------
+// Name: BeginRelaxationJob()
+// Desc: Starts a substep's relaxation
+//------------------------------------------------------------------------------
+void ParticleSystem::BeginRelaxationJob( void* pContext, const int /*unused*/ )
+{
+	( (ParticleSystem*)pContext )->BeginRelaxation();
+}
+
+//------------------------------------------------------------------------------
+// Name: RelaxJob()
+// Desc: Runs one whole relaxation iteration, looking for tears if asked
+//------------------------------------------------------------------------------
+void ParticleSystem::RelaxJob( void* pContext, const int findTears )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+
+	//use the specialised kernel if there is one for this grid
+	if( pSystem->m_pKernel != NULL )
+	{
+		GridKernelParams params;
+		params.pPos				= pSystem->m_pos;
+		params.space			= pSystem->m_particleSpace;
+		params.diagonal			= pSystem->m_diagonalSpace;
+		params.spherePosition	= pSystem->m_spherePosition;
+		params.sphereMinLength	= pSystem->m_sphereRadius + EDGE_CORRECTION;
+		params.pTiles			= pSystem->m_tiles;
+		params.numTiles			= pSystem->m_numTiles;
+		params.pTileMin			= pSystem->m_tileMin;
+		params.pTileMax			= pSystem->m_tileMax;
+		params.pTileActive		= pSystem->m_tileActive;
+		params.pTileTests		= pSystem->m_tileTests;
+
+		pSystem->m_pKernel->pfnRelaxConstraints( params );
+		return;
+	}
+
+	pSystem->m_sweepResidual = pSystem->RelaxIteration( findTears != 0 );
+}
+
+//------------------------------------------------------------------------------
+// Name: RelaxChunkJob()
+// Desc: Relaxes one chunk of a mesh batch. The constraints of a batch share
+//		 no particles, so its chunks can run side by side.
+//------------------------------------------------------------------------------
+void ParticleSystem::RelaxChunkJob( void* pContext, const int chunk )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+	const ConstraintBatch& c = pSystem->m_relaxChunks[ chunk ];
+	double residual = 0.0;
+
+	for( int constraint = c.first; constraint < c.first + c.count; ++constraint )
+	{
+		const ClothConstraint& cc = pSystem->m_constraints[ constraint ];
+		const float length = pSystem->m_solver == SOLVER_XPBD ?
+			RelaxCompliantConstraint( pSystem->m_pos[ cc.particleA ],
+									  pSystem->m_pos[ cc.particleB ], cc.restLength,
+									  pSystem->m_alphaTilde[ cc.type ],
+									  pSystem->m_lambda[ constraint ] ) :
+			RelaxConstraint( pSystem->m_pos[ cc.particleA ], pSystem->m_pos[ cc.particleB ],
+							 cc.restLength, pSystem->m_relaxScale );
+
+		const float error = length - cc.restLength;
+		residual += error * error;
+	}
+
+	pSystem->m_chunkResiduals[ chunk ] = residual;
+}
+
+//------------------------------------------------------------------------------
+// Name: EndSweepJob()
+// Desc: Adds up one sweep's residual, over its chunks if it had any, and
+//		 hands it to EndSweep()
+//------------------------------------------------------------------------------
+void ParticleSystem::EndSweepJob( void* pContext, const int sweep )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+
+	const int first	= pSystem->m_sweepChunkStart[ sweep ];
+	const int last	= pSystem->m_sweepChunkStart[ sweep + 1 ];
+
+	double residual = pSystem->m_sweepResidual;
+	if( first < last )
+	{
+		residual = 0.0;
+		for( int chunk = first; chunk < last; ++chunk )
+			residual += pSystem->m_chunkResiduals[ chunk ];
+	}
+
+	pSystem->EndSweep( sweep % pSystem->m_numIterations, residual );
+}
+
+//------------------------------------------------------------------------------
+// Name: CollideJob()
+// Desc: Extrapolates one tile's particles past the sweep if Chebyshev is on,
+//		 holds them to their anchors, then refits the tile's box and pushes
+//		 them out of the sphere if it reaches it
+//------------------------------------------------------------------------------
+void ParticleSystem::CollideJob( void* pContext, const int tile )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+	const ClothTile& t = pSystem->m_tiles[ tile ];
+	const bool chebyshev = pSystem->m_chebyshev && pSystem->IsAccelerated();
+
+	if( chebyshev )
+	{
+		for( int row = 0; row < t.rows; ++row )
+			pSystem->Extrapolate( t.first + ( row * t.stride ), t.columns );
+	}
+
+	if( !pSystem->m_anchors.empty() )
+	{
+		for( int row = 0; row < t.rows; ++row )
+			pSystem->Attach( t.first + ( row * t.stride ), t.columns );
+	}
+
+	pSystem->CollideTile( tile );
+
+	if( chebyshev )
+	{
+		const int slot = ( pSystem->m_sweep + 1 ) & 1;
+		for( int row = 0; row < t.rows; ++row )
+			pSystem->StoreIterate( t.first + ( row * t.stride ), t.columns, slot );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Name: TearJob()
+// Desc: Tears the constraints found on the last iteration
+//------------------------------------------------------------------------------
+void ParticleSystem::TearJob( void* pContext, const int /*unused*/ )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+
+	if( pSystem->m_numPendingTears > 0 )
+		pSystem->ProcessTears();
+}
+
+//------------------------------------------------------------------------------
+// Name: EmitJob()
+// Desc: Builds the vertices of one tile into the step's vertex buffer
+//------------------------------------------------------------------------------
+void ParticleSystem::EmitJob( void* pContext, const int tile )
+{
+	ParticleSystem* const pSystem = (ParticleSystem*)pContext;
+
+	if( pSystem->m_pStepVertices != NULL )
+		pSystem->FillTileVertices( tile, pSystem->m_pStepVertices );
+}